@@ -0,0 +1,2 @@
+#!/bin/bash
+g++ main.cpp -o bench
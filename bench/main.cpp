@@ -0,0 +1,500 @@
+#include <iostream>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+/*
+    End-to-end latency benchmark
+
+    1. Create a virtual keyboard through /dev/uinput (same approach as legacy Player)
+    2. Start the keybinds daemon in a scratch directory, listening on the virtual keyboard
+       The scratch keybinds.json binds LCTRL + F24 to a marker command writing into a fifo
+    3. Inject the chord, take a timestamp, wait for the marker to show up in the fifo
+    4. Report latency percentiles (keypress -> action)
+
+    -p: passthrough instead, the daemon grabs the virtual keyboard (--grab) and passes its events on through a clone
+        MARKER_KEY alone is not bound, the latency is press -> the press coming out of the clone
+
+    Only needs /dev/uinput, no X server or real keyboard
+*/
+
+#define MARKER_KEY KEY_F24
+#define MARKER_TIMEOUT_MS 2000
+
+
+/*
+    --------------------
+    | VirtualKeyboard  |
+    --------------------
+*/
+
+class VirtualKeyboard
+{
+    public:
+        /* Creates the uinput device, returns the eventX name or an empty string */
+        string create();
+        void press(unsigned short key);
+        void release(unsigned short key);
+        void destroy();
+    private:
+        int fd = -1;
+        void write(unsigned short type, unsigned short code, int value);
+        string findEventNode(const char* sysname);
+};
+
+string VirtualKeyboard::create()
+{
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        cerr << "Failed to open /dev/uinput (run as root?)" << endl;
+        return "";
+    }
+
+    ioctl(fd, UI_SET_EVBIT, EV_KEY);
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    ioctl(fd, UI_SET_KEYBIT, KEY_LEFTCTRL);
+    ioctl(fd, UI_SET_KEYBIT, MARKER_KEY);
+
+    struct uinput_setup setup;
+    memset(&setup, 0, sizeof(setup));
+    setup.id.bustype = BUS_VIRTUAL;
+    setup.id.vendor = 0x1;
+    setup.id.product = 0x1;
+    strcpy(setup.name, "keybindsmanager bench keyboard");
+
+    if(ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+    {
+        cerr << "Failed to create uinput device" << endl;
+        close(fd);
+        fd = -1;
+        return "";
+    }
+
+    char sysname[64];
+    if(ioctl(fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+    {
+        cerr << "Failed to get uinput device sysname" << endl;
+        return "";
+    }
+    return findEventNode(sysname);
+}
+
+string VirtualKeyboard::findEventNode(const char* sysname)
+{
+    /* /sys/devices/virtual/input/inputN/eventX, udev creates /dev/input/eventX shortly after */
+    string sysPath = "/sys/devices/virtual/input/" + string(sysname);
+    for(int attempt = 0; attempt < 200; attempt++)
+    {
+        DIR* dir = opendir(sysPath.c_str());
+        if(dir)
+        {
+            struct dirent* entry;
+            while((entry = readdir(dir)) != nullptr)
+            {
+                if(strncmp(entry->d_name, "event", 5) == 0)
+                {
+                    string name = entry->d_name;
+                    closedir(dir);
+                    if(access(("/dev/input/" + name).c_str(), R_OK) == 0)
+                    {
+                        return name;
+                    }
+                    dir = nullptr;
+                    break;
+                }
+            }
+            if(dir)
+            {
+                closedir(dir);
+            }
+        }
+        usleep(10000);
+    }
+    cerr << "Event node for " << sysPath << " did not appear" << endl;
+    return "";
+}
+
+void VirtualKeyboard::write(unsigned short type, unsigned short code, int value)
+{
+    struct input_event ev[2];
+    memset(ev, 0, sizeof(ev));
+    ev[0].type = type;
+    ev[0].code = code;
+    ev[0].value = value;
+    ev[1].type = EV_SYN;
+    ev[1].code = SYN_REPORT;
+    ev[1].value = 0;
+    /* One frame per write: the key event followed by its SYN_REPORT */
+    ::write(fd, ev, sizeof(ev));
+}
+
+void VirtualKeyboard::press(unsigned short key)
+{
+    write(EV_KEY, key, 1);
+}
+
+void VirtualKeyboard::release(unsigned short key)
+{
+    write(EV_KEY, key, 0);
+}
+
+void VirtualKeyboard::destroy()
+{
+    if(fd >= 0)
+    {
+        ioctl(fd, UI_DEV_DESTROY);
+        close(fd);
+        fd = -1;
+    }
+}
+
+
+/*
+    --------------------
+    | Bench            |
+    --------------------
+*/
+
+class Bench
+{
+    public:
+        const char* binary = "./keybinds";
+        int iterations = 500;
+        int intervalMs = 20;
+        bool passthrough = false;
+
+        int run();
+    private:
+        VirtualKeyboard keyboard;
+        string scratchDir;
+        string fifoPath;
+        int fifo = -1;
+        /* Event node of the clone created by the daemon, passthrough only */
+        int clone = -1;
+        pid_t daemon = -1;
+        vector<long> samples; // Nanoseconds
+
+        bool prepareScratchDir();
+        bool startDaemon(const string& eventNode);
+        bool openClone(const string& eventNode);
+        /* Injects the chord and returns the latency in ns, -1 on timeout */
+        long measureOnce();
+        /* Injects MARKER_KEY alone and returns the latency until the clone sends it in ns, -1 on timeout */
+        long measurePassthrough();
+        void report();
+        void cleanup();
+};
+
+static long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+bool Bench::prepareScratchDir()
+{
+    char dirTemplate[] = "/tmp/keybinds-bench-XXXXXX";
+    if(!mkdtemp(dirTemplate))
+    {
+        cerr << "Failed to create scratch directory" << endl;
+        return false;
+    }
+    scratchDir = dirTemplate;
+    fifoPath = scratchDir + "/marker";
+    if(mkfifo(fifoPath.c_str(), 0600) < 0)
+    {
+        cerr << "Failed to create marker fifo" << endl;
+        return false;
+    }
+    /* O_RDWR keeps the fifo open on our side so the marker writer never sees ENXIO and we never see EOF */
+    fifo = open(fifoPath.c_str(), O_RDWR | O_NONBLOCK);
+
+    ofstream config(scratchDir + "/keybinds.json");
+    config << "[{\"keybind\": [{\"key\": " << KEY_LEFTCTRL << ", \"modifier\": 0}, "
+           << "{\"key\": " << MARKER_KEY << ", \"modifier\": 0}], "
+           << "\"command\": \"printf x > " << fifoPath << "\"}]" << endl;
+    return fifo >= 0 && config.good();
+}
+
+bool Bench::startDaemon(const string& eventNode)
+{
+    char resolved[PATH_MAX];
+    if(!realpath(binary, resolved))
+    {
+        cerr << "Keybinds binary not found: " << binary << endl;
+        return false;
+    }
+
+    daemon = fork();
+    if(daemon == 0)
+    {
+        /* The daemon reads keybinds.json and writes log.txt in its working directory */
+        if(chdir(scratchDir.c_str()) < 0)
+        {
+            _exit(1);
+        }
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        execl(resolved, resolved, "-d", eventNode.c_str(), passthrough ? "--grab" : nullptr, (char*)nullptr);
+        _exit(1);
+    }
+    return daemon > 0;
+}
+
+bool Bench::openClone(const string& eventNode)
+{
+    /* Same name as the virtual keyboard, the other event node */
+    for(int attempt = 0; attempt < 200; attempt++)
+    {
+        DIR* dir = opendir("/sys/class/input");
+        struct dirent* entry;
+        while(dir && (entry = readdir(dir)) != nullptr)
+        {
+            string name = entry->d_name;
+            if(name.compare(0, 5, "event") != 0 || name == eventNode)
+            {
+                continue;
+            }
+            string deviceName;
+            getline(ifstream("/sys/class/input/" + name + "/device/name"), deviceName);
+            if(deviceName == "keybindsmanager bench keyboard")
+            {
+                clone = open(("/dev/input/" + name).c_str(), O_RDONLY | O_NONBLOCK);
+                if(clone >= 0)
+                {
+                    closedir(dir);
+                    cout << "Clone: /dev/input/" << name << endl;
+                    return true;
+                }
+            }
+        }
+        if(dir)
+        {
+            closedir(dir);
+        }
+        usleep(10000);
+    }
+    cerr << "The daemon did not create a clone of the virtual keyboard" << endl;
+    return false;
+}
+
+long Bench::measurePassthrough()
+{
+    struct input_event events[64];
+    while(read(clone, events, sizeof(events)) > 0) {}
+
+    long start = nowNs();
+    keyboard.press(MARKER_KEY);
+
+    long end = -1;
+    while(end < 0)
+    {
+        struct pollfd pfd = { clone, POLLIN, 0 };
+        if(poll(&pfd, 1, MARKER_TIMEOUT_MS) <= 0)
+        {
+            break;
+        }
+        ssize_t bytes = read(clone, events, sizeof(events));
+        for(ssize_t i = 0; i < bytes / (ssize_t)sizeof(events[0]); i++)
+        {
+            if(events[i].type == EV_KEY && events[i].code == MARKER_KEY && events[i].value == 1)
+            {
+                end = nowNs();
+            }
+        }
+    }
+    keyboard.release(MARKER_KEY);
+    return end < 0 ? -1 : end - start;
+}
+
+long Bench::measureOnce()
+{
+    char drain[64];
+    while(read(fifo, drain, sizeof(drain)) > 0) {}
+
+    keyboard.press(KEY_LEFTCTRL);
+    long start = nowNs();
+    keyboard.press(MARKER_KEY);
+
+    struct pollfd pfd = { fifo, POLLIN, 0 };
+    int ready = poll(&pfd, 1, MARKER_TIMEOUT_MS);
+    long end = nowNs();
+
+    keyboard.release(MARKER_KEY);
+    keyboard.release(KEY_LEFTCTRL);
+
+    if(ready <= 0)
+    {
+        return -1;
+    }
+    while(read(fifo, drain, sizeof(drain)) > 0) {}
+    return end - start;
+}
+
+void Bench::report()
+{
+    if(samples.empty())
+    {
+        cerr << "No samples collected" << endl;
+        return;
+    }
+    sort(samples.begin(), samples.end());
+    auto percentile = [this](double p) {
+        size_t index = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+        return samples[index] / 1000.0;
+    };
+    double sum = 0;
+    for(long sample : samples)
+    {
+        sum += sample;
+    }
+
+    cout << (passthrough ? "Keypress -> passed on latency (us), " : "Keypress -> action latency (us), ") << samples.size() << " samples" << endl;
+    cout << "--------------------" << endl;
+    cout << "min:   " << samples.front() / 1000.0 << endl;
+    cout << "p50:   " << percentile(50) << endl;
+    cout << "p90:   " << percentile(90) << endl;
+    cout << "p99:   " << percentile(99) << endl;
+    cout << "p99.9: " << percentile(99.9) << endl;
+    cout << "max:   " << samples.back() / 1000.0 << endl;
+    cout << "mean:  " << sum / samples.size() / 1000.0 << endl;
+}
+
+void Bench::cleanup()
+{
+    if(daemon > 0)
+    {
+        kill(daemon, SIGTERM);
+        waitpid(daemon, nullptr, 0);
+    }
+    keyboard.destroy();
+    if(fifo >= 0)
+    {
+        close(fifo);
+    }
+    if(clone >= 0)
+    {
+        close(clone);
+    }
+    if(!scratchDir.empty())
+    {
+        /* Everything in it: the marker fifo, keybinds.json and whatever the daemon writes next to it (log, binary cache) */
+        DIR* dir = opendir(scratchDir.c_str());
+        struct dirent* entry;
+        while(dir && (entry = readdir(dir)))
+        {
+            if(strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+            {
+                unlink((scratchDir + "/" + entry->d_name).c_str());
+            }
+        }
+        if(dir)
+        {
+            closedir(dir);
+        }
+        rmdir(scratchDir.c_str());
+    }
+}
+
+int Bench::run()
+{
+    string eventNode = keyboard.create();
+    if(eventNode.empty() || !prepareScratchDir() || !startDaemon(eventNode))
+    {
+        cleanup();
+        return 1;
+    }
+    cout << "Virtual keyboard: /dev/input/" << eventNode << endl;
+
+    /* Warm up until the daemon is listening and the first marker arrives */
+    bool ready = false;
+    for(int attempt = 0; attempt < 10 && !ready; attempt++)
+    {
+        ready = measureOnce() >= 0;
+    }
+    if(!ready)
+    {
+        cerr << "Daemon never executed the marker command" << endl;
+        cleanup();
+        return 1;
+    }
+
+    if(passthrough && !openClone(eventNode))
+    {
+        cleanup();
+        return 1;
+    }
+
+    int timeouts = 0;
+    for(int i = 0; i < iterations; i++)
+    {
+        long latency = passthrough ? measurePassthrough() : measureOnce();
+        if(latency < 0)
+        {
+            timeouts++;
+        }
+        else
+        {
+            samples.push_back(latency);
+        }
+        usleep(intervalMs * 1000);
+    }
+
+    report();
+    if(timeouts > 0)
+    {
+        cout << "timeouts: " << timeouts << endl;
+    }
+    cleanup();
+    return timeouts > 0 ? 2 : 0;
+}
+
+
+/*
+    --------------------
+    | Main             |
+    --------------------
+*/
+
+int main(int argc, char* argv[])
+{
+    Bench bench;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            bench.binary = argv[++i];
+        }
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            bench.iterations = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            bench.intervalMs = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-p") == 0)
+        {
+            bench.passthrough = true;
+        }
+    }
+    return bench.run();
+}
@@ -0,0 +1,3 @@
+#!/bin/bash
+# Replays bench/typing.kbrec with the counting allocator, exits with 1 if the event path allocates
+g++ -DCHECK_ALLOCATIONS main.cpp -o keybinds-alloc -levdev -pthread && ./keybinds-alloc -c keybinds.json --replay bench/typing.kbrec --fast --check-alloc
@@ -1,2 +1,2 @@
 #!/bin/bash
-g++ main.cpp -levdev
\ No newline at end of file
+g++ main.cpp -levdev -pthread
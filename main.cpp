@@ -6,10 +6,31 @@
 #include <string.h>
 #include <fstream>
 #include <vector>
-#include <set>
 #include "include/nlohmann/json.hpp"
 #include <algorithm>
 #include <linux/input-event-codes.h>
+#include <linux/input.h>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <cerrno>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/signalfd.h>
+#ifdef HAVE_XKBCOMMON
+#include <xkbcommon/xkbcommon.h>
+#endif
 
 using json = nlohmann::json;
 using namespace std;
@@ -24,6 +45,8 @@ using namespace std;
                 timestamp was the same for keys pressed simultaneously.
                 Now, when the timestamp is the same it compares the keyInts instead.
                 --> custom overload of operator< for the key struct
+    --> Held keys are now a bitmap with an incremental signature, the ordered set is gone
+    --> Press times are the kernel event timestamps (CLOCK_MONOTONIC), the press order is the order events arrive in
 */
 
 /*
@@ -96,247 +119,5167 @@ void Logger::saveLogToFile(string message)
 
 /*
     --------------------
-    | Keybinds Class   |
+    | Allocation Hooks |
     --------------------
 */
 
-class Keybinds
+/*
+    - malloc, calloc, realloc and the aligned allocations are interposed to count heap allocations
+      (operator new goes through malloc)
+    - Only in a build with -DCHECK_ALLOCATIONS, the daemon itself keeps the allocator of libc
+    - Counting is only switched on by --check-alloc, which fails if the steady state event path allocates
+        - Per thread: only the thread reading the events counts, the watcher and reloads don't touch its counter
+*/
+
+static thread_local bool countAllocations = false;
+static thread_local unsigned long allocationCount = 0;
+
+#ifdef CHECK_ALLOCATIONS
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+extern "C" void* malloc(size_t size)
 {
-    private:
-        struct key
-        {
-            int keyInt;
-            int modifier;
-            time_t timestamp;
-            
-            /* WHAT THE HELL O MY GOD OH HELL NO WHO INVITED THIS KID */
-            /* 
-                The error message you encountered, "no match for 'operator<' 
-                (operand types are 'const Keybinds::key' and 'const Keybinds::key')", 
-                suggests that there is no defined comparison operator (operator<) for the Keybinds::key struct. 
-                This comparison operator is required when using std::set as a container for Keybinds::action objects, 
-                as std::set uses this operator to order and compare its elements.
-
-                To resolve the error, we need to provide an overloaded operator< for the Keybinds::key struct, 
-                which allows comparisons between Keybinds::key objects.
-            */
-            bool operator<(const key& other) const
+    allocationCount += countAllocations;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocationCount += countAllocations;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    allocationCount += countAllocations;
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+    allocationCount += countAllocations;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+    allocationCount += countAllocations;
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void** pointer, size_t alignment, size_t size)
+{
+    allocationCount += countAllocations;
+    if(alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+    {
+        return EINVAL;
+    }
+    void* allocated = __libc_memalign(alignment, size);
+    if(!allocated)
+    {
+        return ENOMEM;
+    }
+    *pointer = allocated;
+    return 0;
+}
+#endif
+
+
+/*
+    --------------------
+    | Clock Classes    |
+    --------------------
+*/
+
+/*
+    - Every timing decision (key timestamps, timeouts, windows) reads the time from a Clock
+    - Times are microseconds on the clock's own timeline
+        - SystemClock: CLOCK_MONOTONIC, used when listening to a device
+        - VirtualClock: driven by the recorded event timestamps during a replay,
+          so a replay makes the same decisions no matter how fast it runs
+*/
+
+static long long monotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+class Clock
+{
+    public:
+        virtual ~Clock() {}
+        virtual long long now() = 0;
+};
+
+class SystemClock : public Clock
+{
+    public:
+        long long now() override
+        {
+            return monotonicUs();
+        }
+};
+
+class VirtualClock : public Clock
+{
+    public:
+        long long now() override
+        {
+            return current;
+        }
+        /* Never goes backwards, even if the recording does */
+        void advance(long long us)
+        {
+            if(us > current)
             {
-                /* Ignore the modifier and keyInt when comparing keys, sort set based on unix timestamp */
-                if(timestamp == other.timestamp)
-                {
-                    // If the timestamps are the same, sort based on keyInt. Prevent situations where you press simultaneously
-                    return keyInt < other.keyInt; 
-                }
-                return timestamp < other.timestamp;
+                current = us;
             }
-        };
-        struct action
-        {
-            set<key> keybind;
-            string command;
-        };
-        /*
-            - Cache consists of a vector of actions
-            - Each action consists of a set of keybinds and a command
-                - A set is used to prevent duplicate actions
-                - A set is also used to easily find elements
-            - Each keybind consists of a key and a modifier
-            - For each event received, the keybinds are checked against the cache
+        }
+    private:
+        long long current = 0;
+};
 
-            Example:
-            [
-                {
-                    "keybind": [
-                        {
-                            "key": 28,
-                            "modifier": 0
-                        }
-                    ],
-                    "command": "echo Hello World"
-                }
-            ]
-            This would execute the command "echo Hello World" when the key 28 is pressed
 
-            - The user can dynamically change the keybinds by editing the disk file
-            - The cache is reloaded when the disk file is changed
-        */
-        vector<action> cache;
-        const char* file = "keybinds.json";
+/*
+    --------------------
+    | Executor Class   |
+    --------------------
+*/
 
-        /* 
-            - Set containing the last DIFFERENT keys HELD 
-                - A set is used to prevent duplicate actions
-                - A set is also used to easily find elements
-            - Used to detect keybinds
-        */
-        set<key> keysHeld;
-        int updateKeysHeld(int _key, int modifier);
+/*
+    - Runs commands through /bin/sh without waiting for them, so a slow command never stalls the listener
+    - Finished children are reaped when they exit: SIGCHLD is blocked and read from a signalfd the listener polls,
+      and before every new command (replays don't poll)
+        - Only the pids the executor started are waited for
+        - The children start with an empty signal mask, SIGCHLD stays blocked only in the daemon
+    - Every keybind has an actionState that survives reloads as long as the keybind is unchanged
+        - running counts the children of that keybind that have not been reaped yet
+*/
 
-        Logger logger;
+struct actionState
+{
+    atomic<unsigned long> fired{0};
+    atomic<int> running{0};
+};
 
-        void printCache();
+class Executor
+{
     public:
-        Keybinds()
+        void run(const string& command, const shared_ptr<actionState>& state);
+        /* Blocks SIGCHLD and returns a descriptor readable when a command exits, -1 on failure. Before any thread is started */
+        int watchExits();
+        /* Closes the descriptor of watchExits() */
+        void closeExits();
+        /* Collects the commands that exited */
+        void reap();
+    private:
+        struct child
         {
-            reloadCache();
+            pid_t pid;
+            shared_ptr<actionState> state;
         };
-        void updateDisk();
-        void reloadCache();
-        void checkKeybind(struct input_event ev);
+        vector<child> inFlight;
+        int exitFd = -1;
+
+        Logger logger;
 };
 
+int Executor::watchExits()
+{
+    sigset_t exits;
+    sigemptyset(&exits);
+    sigaddset(&exits, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &exits, nullptr);
+    exitFd = signalfd(-1, &exits, SFD_NONBLOCK | SFD_CLOEXEC);
+    return exitFd;
+}
 
-int Keybinds::updateKeysHeld(int _key, int modifier)
+void Executor::closeExits()
 {
-    /*
-        - Set should only contain keys that are currently held
+    if(exitFd >= 0)
+    {
+        close(exitFd);
+        exitFd = -1;
+    }
+}
 
-        1. Check if key is already in set
-        YES: 2.1 Check if key is unheld --> modifier of a key that is already in a set is 0
-        NO: 2.2 Append the key to the set
-    */
-    
-    key newKey;
-    newKey.keyInt = _key;
-    newKey.modifier = modifier;
-    newKey.timestamp = time(0);
-    
-    /*
-        Find_if function from algorithm
-        Iterates over the set until it meets the lambda requirements, thus the keys being the same
-        If the requirement was never met, the iterator will be equal to the end iterator
-    */
-    auto it = find_if(keysHeld.begin(), keysHeld.end(), [newKey](const key& existingKey) {
-        return existingKey.keyInt == newKey.keyInt;
-    });
+void Executor::run(const string& command, const shared_ptr<actionState>& state)
+{
+    reap();
+
+    pid_t pid;
+    const char* argv[] = { "sh", "-c", command.c_str(), nullptr };
+    posix_spawnattr_t attributes;
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setsigmask(&attributes, &none);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+    int failed = posix_spawn(&pid, "/bin/sh", nullptr, &attributes, (char* const*)argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    if(failed != 0)
+    {
+        logger.error("Failed to execute command: " + command);
+        return;
+    }
+    state->running++;
+    inFlight.push_back({pid, state});
+    logger.log("Executed command: " + command);
+}
+
+void Executor::reap()
+{
+    /* Drained first, an exit signalled after this is read on the next wake up */
+    struct signalfd_siginfo info;
+    while(exitFd >= 0 && read(exitFd, &info, sizeof(info)) > 0) {}
 
-    if(it == keysHeld.end())
+    /* Other children of the process are not ours to collect */
+    for(size_t i = 0; i < inFlight.size();)
     {
-        // Key is not present in the set
-        if(newKey.modifier != 0) /* Prevent buggy situations where the 0 modifier is the only key in the set */
+        if(waitpid(inFlight[i].pid, nullptr, WNOHANG) == 0)
         {
-            keysHeld.insert(newKey);
+            i++;
+            continue;
         }
+        inFlight[i].state->running--;
+        inFlight[i] = inFlight.back();
+        inFlight.pop_back();
+    }
+}
+
+
+/*
+    --------------------
+    | Timer Wheel      |
+    --------------------
+*/
+
+/*
+    - Pending timers of the keybinds (tap and hold decisions), on the clock of the keybinds
+    - Hierarchical timer wheel: TIMER_WHEEL_LEVELS levels of 64 slots, 1 ms ticks on level 0, 64 ms on level 1, ...
+        - A timer goes to the level of the highest 6 bit digit its tick differs in from the current tick,
+          in the slot of that digit: level 0 holds the next 64 ms, level 3 the next 4.6 hours
+        - When the current tick reaches a slot of a higher level, its timers are cascaded down a level
+        - The top level wraps around, timers further out than it reaches wait in its last slot and are placed again from there
+    - Schedule and cancel are O(1): the timers are nodes of a pool linked into their slot, freed nodes are reused
+    - A bitmap of occupied slots per level finds the next tick with work in a few instructions,
+      advancing over an idle stretch jumps straight to it instead of walking every tick
+    - The owner polls next() and calls advance() when it is due, there is no thread and no periodic tick
+*/
+
+#define TIMER_TICK_US 1000 // 1ms
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_POOL_RESERVE 4096 // Nodes allocated up front, more only when this many timers are pending
+#define NO_TIMER UINT32_MAX
+
+class TimerWheel
+{
+    public:
+        TimerWheel();
+        /* Returns a handle for cancel(), only valid until the timer expires or is cancelled */
+        uint32_t schedule(long long at, uint32_t kind, uint64_t data);
+        void cancel(uint32_t timer);
+        /* Clock time the earliest timer is due, -1 when there is none */
+        long long next();
+        /* Expires every timer due at now, calling expired(kind, data) in order of their ticks */
+        template<class Expired> void advance(long long now, Expired expired);
+        size_t pending() const { return count; }
+    private:
+        struct node
+        {
+            uint64_t tick;
+            uint64_t data;
+            uint32_t kind;
+            uint32_t prev;
+            uint32_t next;
+            /* level * TIMER_WHEEL_SLOTS + slot, NO_TIMER while free */
+            uint32_t bucket;
+        };
+        vector<node> nodes;
+        uint32_t freeList = NO_TIMER;
+        uint32_t heads[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+        uint64_t occupied[TIMER_WHEEL_LEVELS] = {};
+        uint64_t currentTick = 0;
+        size_t count = 0;
+
+        void insert(uint32_t timer);
+        void unlink(uint32_t timer);
+        uint64_t nextTick();
+};
+
+TimerWheel::TimerWheel()
+{
+    nodes.reserve(TIMER_POOL_RESERVE);
+    fill(heads, heads + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, NO_TIMER);
+}
+
+uint32_t TimerWheel::schedule(long long at, uint32_t kind, uint64_t data)
+{
+    uint32_t timer = freeList;
+    if(timer == NO_TIMER)
+    {
+        timer = nodes.size();
+        nodes.push_back({});
+    }
+    else
+    {
+        freeList = nodes[timer].next;
+    }
+    /* Rounded up, a timer never fires early. Due ones fire on the next tick */
+    uint64_t tick = at > 0 ? (at + TIMER_TICK_US - 1) / TIMER_TICK_US : 0;
+    nodes[timer].tick = max(tick, currentTick + 1);
+    nodes[timer].kind = kind;
+    nodes[timer].data = data;
+    insert(timer);
+    count++;
+    return timer;
+}
+
+void TimerWheel::cancel(uint32_t timer)
+{
+    if(timer >= nodes.size() || nodes[timer].bucket == NO_TIMER)
+    {
+        return;
+    }
+    unlink(timer);
+    nodes[timer].next = freeList;
+    freeList = timer;
+    count--;
+}
+
+void TimerWheel::insert(uint32_t timer)
+{
+    node& n = nodes[timer];
+    uint64_t differs = n.tick ^ currentTick;
+    int level = n.tick <= currentTick ? 0 : (63 - __builtin_clzll(differs)) / TIMER_WHEEL_BITS;
+    /* Due timers (cascaded onto the current tick) go to the current slot, which is expired next */
+    uint64_t tick = max(n.tick, currentTick);
+    if(level >= TIMER_WHEEL_LEVELS - 1)
+    {
+        /*
+            The top level wraps around: its slots cover the next TIMER_WHEEL_SLOTS top level ticks, the current slot included
+            Out of range: the slot that is reached last, placed again from there
+        */
+        level = TIMER_WHEEL_LEVELS - 1;
+        tick = n.tick - currentTick < (1ULL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) ? n.tick : currentTick;
+    }
+    uint32_t slot = (tick >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+    n.bucket = level * TIMER_WHEEL_SLOTS + slot;
+    n.prev = NO_TIMER;
+    n.next = heads[n.bucket];
+    if(n.next != NO_TIMER)
+    {
+        nodes[n.next].prev = timer;
+    }
+    heads[n.bucket] = timer;
+    occupied[level] |= 1ULL << slot;
+}
+
+void TimerWheel::unlink(uint32_t timer)
+{
+    node& n = nodes[timer];
+    if(n.prev != NO_TIMER)
+    {
+        nodes[n.prev].next = n.next;
     }
     else
     {
-        // Key is present in the set
-        const key& foundKey = *it;
+        heads[n.bucket] = n.next;
+    }
+    if(n.next != NO_TIMER)
+    {
+        nodes[n.next].prev = n.prev;
+    }
+    if(heads[n.bucket] == NO_TIMER)
+    {
+        occupied[n.bucket / TIMER_WHEEL_SLOTS] &= ~(1ULL << (n.bucket % TIMER_WHEEL_SLOTS));
+    }
+    n.bucket = NO_TIMER;
+}
 
-        if(foundKey.modifier != 0 && newKey.modifier == 0)
+uint64_t TimerWheel::nextTick()
+{
+    /* First tick after the current one where a slot expires (level 0) or cascades (higher levels) */
+    uint64_t earliest = UINT64_MAX;
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+    {
+        if(!occupied[level])
         {
-            keysHeld.erase(it);
+            continue;
         }
+        int shift = level * TIMER_WHEEL_BITS;
+        int after = ((currentTick >> shift) + 1) & (TIMER_WHEEL_SLOTS - 1);
+        uint64_t rotated = occupied[level] >> after | (after ? occupied[level] << (TIMER_WHEEL_SLOTS - after) : 0);
+        uint64_t distance = __builtin_ctzll(rotated) + 1;
+        earliest = min(earliest, ((currentTick >> shift) + distance) << shift);
+    }
+    return earliest;
+}
+
+long long TimerWheel::next()
+{
+    if(count == 0)
+    {
+        return -1;
     }
+    /* Only level 0 slots hold exact ticks, a cascade point is a lower bound that is good enough for a wakeup */
+    return nextTick() * TIMER_TICK_US;
+}
 
-    if(logger.showKeysHeld)
+template<class Expired> void TimerWheel::advance(long long now, Expired expired)
+{
+    uint64_t target = now > 0 ? now / TIMER_TICK_US : 0;
+    while(count > 0)
     {
-        cout << endl << "--------------------" << endl;
-        for(const auto& element : keysHeld)
+        uint64_t tick = nextTick();
+        if(tick > target)
         {
-            cout << "KEY: " << element.keyInt << " MODIFIER: " << element.modifier << " - ";
+            break;
+        }
+        currentTick = tick;
+        /* Higher levels first, their timers can drop all the way into the current level 0 slot */
+        for(int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+            int shift = level * TIMER_WHEEL_BITS;
+            if(tick & ((1ULL << shift) - 1))
+            {
+                continue;
+            }
+            /* Detached first, timers still out of range go back into the same slot */
+            uint32_t bucket = level * TIMER_WHEEL_SLOTS + ((tick >> shift) & (TIMER_WHEEL_SLOTS - 1));
+            uint32_t timer = heads[bucket];
+            heads[bucket] = NO_TIMER;
+            occupied[level] &= ~(1ULL << (bucket % TIMER_WHEEL_SLOTS));
+            while(timer != NO_TIMER)
+            {
+                uint32_t next = nodes[timer].next;
+                insert(timer);
+                timer = next;
+            }
+        }
+        /* Freed before the callback, which may schedule or cancel timers */
+        uint32_t bucket = tick & (TIMER_WHEEL_SLOTS - 1);
+        while(heads[bucket] != NO_TIMER)
+        {
+            uint32_t timer = heads[bucket];
+            uint32_t kind = nodes[timer].kind;
+            uint64_t data = nodes[timer].data;
+            cancel(timer);
+            expired(kind, data);
         }
-        cout << endl << "--------------------" << endl;
     }
-    
-    return 0;
+    currentTick = max(currentTick, target);
+}
+
+
+/*
+    --------------------
+    | Key Names        |
+    --------------------
+*/
+
+/*
+    - Symbolic key names for keybinds.json, the values come from linux/input-event-codes.h
+        - "KEY_LEFTCTRL", "leftctrl", "BTN_LEFT" and a few aliases like "altgr" (right alt)
+        - Case-insensitive, the KEY_ prefix is optional
+    - Modifier classes: "ctrl", "shift", "alt" and "super" (or "meta", "win") in the keys of a keybind match the left or the right key
+        - A class is a pseudo key code above the real ones, the keybind stays one action with one signature
+        - Remaps, dual-role keys and the keys sent need real keys, there the names are aliases of the left keys
+    - Resolved once while loading through a perfect hash table that is built at compile time
+        - Hash and displace: the first hash picks a bucket, the bucket's seed picks the slot
+        - A lookup is two hashes and one string compare, no probing
+*/
+
+#define KEY_NAME_LIST \
+    KEY_NAME(KEY_RESERVED) KEY_NAME(KEY_ESC) KEY_NAME(KEY_1) KEY_NAME(KEY_2) \
+    KEY_NAME(KEY_3) KEY_NAME(KEY_4) KEY_NAME(KEY_5) KEY_NAME(KEY_6) \
+    KEY_NAME(KEY_7) KEY_NAME(KEY_8) KEY_NAME(KEY_9) KEY_NAME(KEY_0) \
+    KEY_NAME(KEY_MINUS) KEY_NAME(KEY_EQUAL) KEY_NAME(KEY_BACKSPACE) KEY_NAME(KEY_TAB) \
+    KEY_NAME(KEY_Q) KEY_NAME(KEY_W) KEY_NAME(KEY_E) KEY_NAME(KEY_R) \
+    KEY_NAME(KEY_T) KEY_NAME(KEY_Y) KEY_NAME(KEY_U) KEY_NAME(KEY_I) \
+    KEY_NAME(KEY_O) KEY_NAME(KEY_P) KEY_NAME(KEY_LEFTBRACE) KEY_NAME(KEY_RIGHTBRACE) \
+    KEY_NAME(KEY_ENTER) KEY_NAME(KEY_LEFTCTRL) KEY_NAME(KEY_A) KEY_NAME(KEY_S) \
+    KEY_NAME(KEY_D) KEY_NAME(KEY_F) KEY_NAME(KEY_G) KEY_NAME(KEY_H) \
+    KEY_NAME(KEY_J) KEY_NAME(KEY_K) KEY_NAME(KEY_L) KEY_NAME(KEY_SEMICOLON) \
+    KEY_NAME(KEY_APOSTROPHE) KEY_NAME(KEY_GRAVE) KEY_NAME(KEY_LEFTSHIFT) KEY_NAME(KEY_BACKSLASH) \
+    KEY_NAME(KEY_Z) KEY_NAME(KEY_X) KEY_NAME(KEY_C) KEY_NAME(KEY_V) \
+    KEY_NAME(KEY_B) KEY_NAME(KEY_N) KEY_NAME(KEY_M) KEY_NAME(KEY_COMMA) \
+    KEY_NAME(KEY_DOT) KEY_NAME(KEY_SLASH) KEY_NAME(KEY_RIGHTSHIFT) KEY_NAME(KEY_KPASTERISK) \
+    KEY_NAME(KEY_LEFTALT) KEY_NAME(KEY_SPACE) KEY_NAME(KEY_CAPSLOCK) KEY_NAME(KEY_F1) \
+    KEY_NAME(KEY_F2) KEY_NAME(KEY_F3) KEY_NAME(KEY_F4) KEY_NAME(KEY_F5) \
+    KEY_NAME(KEY_F6) KEY_NAME(KEY_F7) KEY_NAME(KEY_F8) KEY_NAME(KEY_F9) \
+    KEY_NAME(KEY_F10) KEY_NAME(KEY_NUMLOCK) KEY_NAME(KEY_SCROLLLOCK) KEY_NAME(KEY_KP7) \
+    KEY_NAME(KEY_KP8) KEY_NAME(KEY_KP9) KEY_NAME(KEY_KPMINUS) KEY_NAME(KEY_KP4) \
+    KEY_NAME(KEY_KP5) KEY_NAME(KEY_KP6) KEY_NAME(KEY_KPPLUS) KEY_NAME(KEY_KP1) \
+    KEY_NAME(KEY_KP2) KEY_NAME(KEY_KP3) KEY_NAME(KEY_KP0) KEY_NAME(KEY_KPDOT) \
+    KEY_NAME(KEY_ZENKAKUHANKAKU) KEY_NAME(KEY_102ND) KEY_NAME(KEY_F11) KEY_NAME(KEY_F12) \
+    KEY_NAME(KEY_RO) KEY_NAME(KEY_KATAKANA) KEY_NAME(KEY_HIRAGANA) KEY_NAME(KEY_HENKAN) \
+    KEY_NAME(KEY_KATAKANAHIRAGANA) KEY_NAME(KEY_MUHENKAN) KEY_NAME(KEY_KPJPCOMMA) KEY_NAME(KEY_KPENTER) \
+    KEY_NAME(KEY_RIGHTCTRL) KEY_NAME(KEY_KPSLASH) KEY_NAME(KEY_SYSRQ) KEY_NAME(KEY_RIGHTALT) \
+    KEY_NAME(KEY_LINEFEED) KEY_NAME(KEY_HOME) KEY_NAME(KEY_UP) KEY_NAME(KEY_PAGEUP) \
+    KEY_NAME(KEY_LEFT) KEY_NAME(KEY_RIGHT) KEY_NAME(KEY_END) KEY_NAME(KEY_DOWN) \
+    KEY_NAME(KEY_PAGEDOWN) KEY_NAME(KEY_INSERT) KEY_NAME(KEY_DELETE) KEY_NAME(KEY_MACRO) \
+    KEY_NAME(KEY_MUTE) KEY_NAME(KEY_VOLUMEDOWN) KEY_NAME(KEY_VOLUMEUP) KEY_NAME(KEY_POWER) \
+    KEY_NAME(KEY_KPEQUAL) KEY_NAME(KEY_KPPLUSMINUS) KEY_NAME(KEY_PAUSE) KEY_NAME(KEY_SCALE) \
+    KEY_NAME(KEY_KPCOMMA) KEY_NAME(KEY_HANGEUL) KEY_NAME(KEY_HANGUEL) KEY_NAME(KEY_HANJA) \
+    KEY_NAME(KEY_YEN) KEY_NAME(KEY_LEFTMETA) KEY_NAME(KEY_RIGHTMETA) KEY_NAME(KEY_COMPOSE) \
+    KEY_NAME(KEY_STOP) KEY_NAME(KEY_AGAIN) KEY_NAME(KEY_PROPS) KEY_NAME(KEY_UNDO) \
+    KEY_NAME(KEY_FRONT) KEY_NAME(KEY_COPY) KEY_NAME(KEY_OPEN) KEY_NAME(KEY_PASTE) \
+    KEY_NAME(KEY_FIND) KEY_NAME(KEY_CUT) KEY_NAME(KEY_HELP) KEY_NAME(KEY_MENU) \
+    KEY_NAME(KEY_CALC) KEY_NAME(KEY_SETUP) KEY_NAME(KEY_SLEEP) KEY_NAME(KEY_WAKEUP) \
+    KEY_NAME(KEY_FILE) KEY_NAME(KEY_SENDFILE) KEY_NAME(KEY_DELETEFILE) KEY_NAME(KEY_XFER) \
+    KEY_NAME(KEY_PROG1) KEY_NAME(KEY_PROG2) KEY_NAME(KEY_WWW) KEY_NAME(KEY_MSDOS) \
+    KEY_NAME(KEY_COFFEE) KEY_NAME(KEY_SCREENLOCK) KEY_NAME(KEY_ROTATE_DISPLAY) KEY_NAME(KEY_DIRECTION) \
+    KEY_NAME(KEY_CYCLEWINDOWS) KEY_NAME(KEY_MAIL) KEY_NAME(KEY_BOOKMARKS) KEY_NAME(KEY_COMPUTER) \
+    KEY_NAME(KEY_BACK) KEY_NAME(KEY_FORWARD) KEY_NAME(KEY_CLOSECD) KEY_NAME(KEY_EJECTCD) \
+    KEY_NAME(KEY_EJECTCLOSECD) KEY_NAME(KEY_NEXTSONG) KEY_NAME(KEY_PLAYPAUSE) KEY_NAME(KEY_PREVIOUSSONG) \
+    KEY_NAME(KEY_STOPCD) KEY_NAME(KEY_RECORD) KEY_NAME(KEY_REWIND) KEY_NAME(KEY_PHONE) \
+    KEY_NAME(KEY_ISO) KEY_NAME(KEY_CONFIG) KEY_NAME(KEY_HOMEPAGE) KEY_NAME(KEY_REFRESH) \
+    KEY_NAME(KEY_EXIT) KEY_NAME(KEY_MOVE) KEY_NAME(KEY_EDIT) KEY_NAME(KEY_SCROLLUP) \
+    KEY_NAME(KEY_SCROLLDOWN) KEY_NAME(KEY_KPLEFTPAREN) KEY_NAME(KEY_KPRIGHTPAREN) KEY_NAME(KEY_NEW) \
+    KEY_NAME(KEY_REDO) KEY_NAME(KEY_F13) KEY_NAME(KEY_F14) KEY_NAME(KEY_F15) \
+    KEY_NAME(KEY_F16) KEY_NAME(KEY_F17) KEY_NAME(KEY_F18) KEY_NAME(KEY_F19) \
+    KEY_NAME(KEY_F20) KEY_NAME(KEY_F21) KEY_NAME(KEY_F22) KEY_NAME(KEY_F23) \
+    KEY_NAME(KEY_F24) KEY_NAME(KEY_PLAYCD) KEY_NAME(KEY_PAUSECD) KEY_NAME(KEY_PROG3) \
+    KEY_NAME(KEY_PROG4) KEY_NAME(KEY_ALL_APPLICATIONS) KEY_NAME(KEY_DASHBOARD) KEY_NAME(KEY_SUSPEND) \
+    KEY_NAME(KEY_CLOSE) KEY_NAME(KEY_PLAY) KEY_NAME(KEY_FASTFORWARD) KEY_NAME(KEY_BASSBOOST) \
+    KEY_NAME(KEY_PRINT) KEY_NAME(KEY_HP) KEY_NAME(KEY_CAMERA) KEY_NAME(KEY_SOUND) \
+    KEY_NAME(KEY_QUESTION) KEY_NAME(KEY_EMAIL) KEY_NAME(KEY_CHAT) KEY_NAME(KEY_SEARCH) \
+    KEY_NAME(KEY_CONNECT) KEY_NAME(KEY_FINANCE) KEY_NAME(KEY_SPORT) KEY_NAME(KEY_SHOP) \
+    KEY_NAME(KEY_ALTERASE) KEY_NAME(KEY_CANCEL) KEY_NAME(KEY_BRIGHTNESSDOWN) KEY_NAME(KEY_BRIGHTNESSUP) \
+    KEY_NAME(KEY_MEDIA) KEY_NAME(KEY_SWITCHVIDEOMODE) KEY_NAME(KEY_KBDILLUMTOGGLE) KEY_NAME(KEY_KBDILLUMDOWN) \
+    KEY_NAME(KEY_KBDILLUMUP) KEY_NAME(KEY_SEND) KEY_NAME(KEY_REPLY) KEY_NAME(KEY_FORWARDMAIL) \
+    KEY_NAME(KEY_SAVE) KEY_NAME(KEY_DOCUMENTS) KEY_NAME(KEY_BATTERY) KEY_NAME(KEY_BLUETOOTH) \
+    KEY_NAME(KEY_WLAN) KEY_NAME(KEY_UWB) KEY_NAME(KEY_UNKNOWN) KEY_NAME(KEY_VIDEO_NEXT) \
+    KEY_NAME(KEY_VIDEO_PREV) KEY_NAME(KEY_BRIGHTNESS_CYCLE) KEY_NAME(KEY_BRIGHTNESS_AUTO) KEY_NAME(KEY_BRIGHTNESS_ZERO) \
+    KEY_NAME(KEY_DISPLAY_OFF) KEY_NAME(KEY_WWAN) KEY_NAME(KEY_WIMAX) KEY_NAME(KEY_RFKILL) \
+    KEY_NAME(KEY_MICMUTE) KEY_NAME(BTN_MISC) KEY_NAME(BTN_0) KEY_NAME(BTN_1) \
+    KEY_NAME(BTN_2) KEY_NAME(BTN_3) KEY_NAME(BTN_4) KEY_NAME(BTN_5) \
+    KEY_NAME(BTN_6) KEY_NAME(BTN_7) KEY_NAME(BTN_8) KEY_NAME(BTN_9) \
+    KEY_NAME(BTN_LEFT) KEY_NAME(BTN_MOUSE) KEY_NAME(BTN_RIGHT) KEY_NAME(BTN_MIDDLE) \
+    KEY_NAME(BTN_SIDE) KEY_NAME(BTN_EXTRA) KEY_NAME(BTN_FORWARD) KEY_NAME(BTN_BACK) \
+    KEY_NAME(BTN_TASK) KEY_NAME(BTN_JOYSTICK) KEY_NAME(BTN_TRIGGER) KEY_NAME(BTN_THUMB) \
+    KEY_NAME(BTN_THUMB2) KEY_NAME(BTN_TOP) KEY_NAME(BTN_TOP2) KEY_NAME(BTN_PINKIE) \
+    KEY_NAME(BTN_BASE) KEY_NAME(BTN_BASE2) KEY_NAME(BTN_BASE3) KEY_NAME(BTN_BASE4) \
+    KEY_NAME(BTN_BASE5) KEY_NAME(BTN_BASE6) KEY_NAME(BTN_DEAD) KEY_NAME(BTN_GAMEPAD) \
+    KEY_NAME(BTN_SOUTH) KEY_NAME(BTN_A) KEY_NAME(BTN_EAST) KEY_NAME(BTN_B) \
+    KEY_NAME(BTN_C) KEY_NAME(BTN_NORTH) KEY_NAME(BTN_X) KEY_NAME(BTN_WEST) \
+    KEY_NAME(BTN_Y) KEY_NAME(BTN_Z) KEY_NAME(BTN_TL) KEY_NAME(BTN_TR) \
+    KEY_NAME(BTN_TL2) KEY_NAME(BTN_TR2) KEY_NAME(BTN_SELECT) KEY_NAME(BTN_START) \
+    KEY_NAME(BTN_MODE) KEY_NAME(BTN_THUMBL) KEY_NAME(BTN_THUMBR) KEY_NAME(BTN_DIGI) \
+    KEY_NAME(BTN_TOOL_PEN) KEY_NAME(BTN_TOOL_RUBBER) KEY_NAME(BTN_TOOL_BRUSH) KEY_NAME(BTN_TOOL_PENCIL) \
+    KEY_NAME(BTN_TOOL_AIRBRUSH) KEY_NAME(BTN_TOOL_FINGER) KEY_NAME(BTN_TOOL_MOUSE) KEY_NAME(BTN_TOOL_LENS) \
+    KEY_NAME(BTN_TOOL_QUINTTAP) KEY_NAME(BTN_STYLUS3) KEY_NAME(BTN_TOUCH) KEY_NAME(BTN_STYLUS) \
+    KEY_NAME(BTN_STYLUS2) KEY_NAME(BTN_TOOL_DOUBLETAP) KEY_NAME(BTN_TOOL_TRIPLETAP) KEY_NAME(BTN_TOOL_QUADTAP) \
+    KEY_NAME(BTN_WHEEL) KEY_NAME(BTN_GEAR_DOWN) KEY_NAME(BTN_GEAR_UP) KEY_NAME(KEY_OK) \
+    KEY_NAME(KEY_SELECT) KEY_NAME(KEY_GOTO) KEY_NAME(KEY_CLEAR) KEY_NAME(KEY_POWER2) \
+    KEY_NAME(KEY_OPTION) KEY_NAME(KEY_INFO) KEY_NAME(KEY_TIME) KEY_NAME(KEY_VENDOR) \
+    KEY_NAME(KEY_ARCHIVE) KEY_NAME(KEY_PROGRAM) KEY_NAME(KEY_CHANNEL) KEY_NAME(KEY_FAVORITES) \
+    KEY_NAME(KEY_EPG) KEY_NAME(KEY_PVR) KEY_NAME(KEY_MHP) KEY_NAME(KEY_LANGUAGE) \
+    KEY_NAME(KEY_TITLE) KEY_NAME(KEY_SUBTITLE) KEY_NAME(KEY_ANGLE) KEY_NAME(KEY_FULL_SCREEN) \
+    KEY_NAME(KEY_ZOOM) KEY_NAME(KEY_MODE) KEY_NAME(KEY_KEYBOARD) KEY_NAME(KEY_ASPECT_RATIO) \
+    KEY_NAME(KEY_SCREEN) KEY_NAME(KEY_PC) KEY_NAME(KEY_TV) KEY_NAME(KEY_TV2) \
+    KEY_NAME(KEY_VCR) KEY_NAME(KEY_VCR2) KEY_NAME(KEY_SAT) KEY_NAME(KEY_SAT2) \
+    KEY_NAME(KEY_CD) KEY_NAME(KEY_TAPE) KEY_NAME(KEY_RADIO) KEY_NAME(KEY_TUNER) \
+    KEY_NAME(KEY_PLAYER) KEY_NAME(KEY_TEXT) KEY_NAME(KEY_DVD) KEY_NAME(KEY_AUX) \
+    KEY_NAME(KEY_MP3) KEY_NAME(KEY_AUDIO) KEY_NAME(KEY_VIDEO) KEY_NAME(KEY_DIRECTORY) \
+    KEY_NAME(KEY_LIST) KEY_NAME(KEY_MEMO) KEY_NAME(KEY_CALENDAR) KEY_NAME(KEY_RED) \
+    KEY_NAME(KEY_GREEN) KEY_NAME(KEY_YELLOW) KEY_NAME(KEY_BLUE) KEY_NAME(KEY_CHANNELUP) \
+    KEY_NAME(KEY_CHANNELDOWN) KEY_NAME(KEY_FIRST) KEY_NAME(KEY_LAST) KEY_NAME(KEY_AB) \
+    KEY_NAME(KEY_NEXT) KEY_NAME(KEY_RESTART) KEY_NAME(KEY_SLOW) KEY_NAME(KEY_SHUFFLE) \
+    KEY_NAME(KEY_BREAK) KEY_NAME(KEY_PREVIOUS) KEY_NAME(KEY_DIGITS) KEY_NAME(KEY_TEEN) \
+    KEY_NAME(KEY_TWEN) KEY_NAME(KEY_VIDEOPHONE) KEY_NAME(KEY_GAMES) KEY_NAME(KEY_ZOOMIN) \
+    KEY_NAME(KEY_ZOOMOUT) KEY_NAME(KEY_ZOOMRESET) KEY_NAME(KEY_WORDPROCESSOR) KEY_NAME(KEY_EDITOR) \
+    KEY_NAME(KEY_SPREADSHEET) KEY_NAME(KEY_GRAPHICSEDITOR) KEY_NAME(KEY_PRESENTATION) KEY_NAME(KEY_DATABASE) \
+    KEY_NAME(KEY_NEWS) KEY_NAME(KEY_VOICEMAIL) KEY_NAME(KEY_ADDRESSBOOK) KEY_NAME(KEY_MESSENGER) \
+    KEY_NAME(KEY_DISPLAYTOGGLE) KEY_NAME(KEY_BRIGHTNESS_TOGGLE) KEY_NAME(KEY_SPELLCHECK) KEY_NAME(KEY_LOGOFF) \
+    KEY_NAME(KEY_DOLLAR) KEY_NAME(KEY_EURO) KEY_NAME(KEY_FRAMEBACK) KEY_NAME(KEY_FRAMEFORWARD) \
+    KEY_NAME(KEY_CONTEXT_MENU) KEY_NAME(KEY_MEDIA_REPEAT) KEY_NAME(KEY_10CHANNELSUP) KEY_NAME(KEY_10CHANNELSDOWN) \
+    KEY_NAME(KEY_IMAGES) KEY_NAME(KEY_NOTIFICATION_CENTER) KEY_NAME(KEY_PICKUP_PHONE) KEY_NAME(KEY_HANGUP_PHONE) \
+    KEY_NAME(KEY_LINK_PHONE) KEY_NAME(KEY_DEL_EOL) KEY_NAME(KEY_DEL_EOS) KEY_NAME(KEY_INS_LINE) \
+    KEY_NAME(KEY_DEL_LINE) KEY_NAME(KEY_FN) KEY_NAME(KEY_FN_ESC) KEY_NAME(KEY_FN_F1) \
+    KEY_NAME(KEY_FN_F2) KEY_NAME(KEY_FN_F3) KEY_NAME(KEY_FN_F4) KEY_NAME(KEY_FN_F5) \
+    KEY_NAME(KEY_FN_F6) KEY_NAME(KEY_FN_F7) KEY_NAME(KEY_FN_F8) KEY_NAME(KEY_FN_F9) \
+    KEY_NAME(KEY_FN_F10) KEY_NAME(KEY_FN_F11) KEY_NAME(KEY_FN_F12) KEY_NAME(KEY_FN_1) \
+    KEY_NAME(KEY_FN_2) KEY_NAME(KEY_FN_D) KEY_NAME(KEY_FN_E) KEY_NAME(KEY_FN_F) \
+    KEY_NAME(KEY_FN_S) KEY_NAME(KEY_FN_B) KEY_NAME(KEY_FN_RIGHT_SHIFT) KEY_NAME(KEY_BRL_DOT1) \
+    KEY_NAME(KEY_BRL_DOT2) KEY_NAME(KEY_BRL_DOT3) KEY_NAME(KEY_BRL_DOT4) KEY_NAME(KEY_BRL_DOT5) \
+    KEY_NAME(KEY_BRL_DOT6) KEY_NAME(KEY_BRL_DOT7) KEY_NAME(KEY_BRL_DOT8) KEY_NAME(KEY_BRL_DOT9) \
+    KEY_NAME(KEY_BRL_DOT10) KEY_NAME(KEY_NUMERIC_0) KEY_NAME(KEY_NUMERIC_1) KEY_NAME(KEY_NUMERIC_2) \
+    KEY_NAME(KEY_NUMERIC_3) KEY_NAME(KEY_NUMERIC_4) KEY_NAME(KEY_NUMERIC_5) KEY_NAME(KEY_NUMERIC_6) \
+    KEY_NAME(KEY_NUMERIC_7) KEY_NAME(KEY_NUMERIC_8) KEY_NAME(KEY_NUMERIC_9) KEY_NAME(KEY_NUMERIC_STAR) \
+    KEY_NAME(KEY_NUMERIC_POUND) KEY_NAME(KEY_NUMERIC_A) KEY_NAME(KEY_NUMERIC_B) KEY_NAME(KEY_NUMERIC_C) \
+    KEY_NAME(KEY_NUMERIC_D) KEY_NAME(KEY_CAMERA_FOCUS) KEY_NAME(KEY_WPS_BUTTON) KEY_NAME(KEY_TOUCHPAD_TOGGLE) \
+    KEY_NAME(KEY_TOUCHPAD_ON) KEY_NAME(KEY_TOUCHPAD_OFF) KEY_NAME(KEY_CAMERA_ZOOMIN) KEY_NAME(KEY_CAMERA_ZOOMOUT) \
+    KEY_NAME(KEY_CAMERA_UP) KEY_NAME(KEY_CAMERA_DOWN) KEY_NAME(KEY_CAMERA_LEFT) KEY_NAME(KEY_CAMERA_RIGHT) \
+    KEY_NAME(KEY_ATTENDANT_ON) KEY_NAME(KEY_ATTENDANT_OFF) KEY_NAME(KEY_ATTENDANT_TOGGLE) KEY_NAME(KEY_LIGHTS_TOGGLE) \
+    KEY_NAME(BTN_DPAD_UP) KEY_NAME(BTN_DPAD_DOWN) KEY_NAME(BTN_DPAD_LEFT) KEY_NAME(BTN_DPAD_RIGHT) \
+    KEY_NAME(KEY_ALS_TOGGLE) KEY_NAME(KEY_ROTATE_LOCK_TOGGLE) KEY_NAME(KEY_REFRESH_RATE_TOGGLE) KEY_NAME(KEY_BUTTONCONFIG) \
+    KEY_NAME(KEY_TASKMANAGER) KEY_NAME(KEY_JOURNAL) KEY_NAME(KEY_CONTROLPANEL) KEY_NAME(KEY_APPSELECT) \
+    KEY_NAME(KEY_SCREENSAVER) KEY_NAME(KEY_VOICECOMMAND) KEY_NAME(KEY_ASSISTANT) KEY_NAME(KEY_KBD_LAYOUT_NEXT) \
+    KEY_NAME(KEY_EMOJI_PICKER) KEY_NAME(KEY_DICTATE) KEY_NAME(KEY_BRIGHTNESS_MIN) KEY_NAME(KEY_BRIGHTNESS_MAX) \
+    KEY_NAME(KEY_KBDINPUTASSIST_PREV) KEY_NAME(KEY_KBDINPUTASSIST_NEXT) KEY_NAME(KEY_KBDINPUTASSIST_PREVGROUP) KEY_NAME(KEY_KBDINPUTASSIST_NEXTGROUP) \
+    KEY_NAME(KEY_KBDINPUTASSIST_ACCEPT) KEY_NAME(KEY_KBDINPUTASSIST_CANCEL) KEY_NAME(KEY_RIGHT_UP) KEY_NAME(KEY_RIGHT_DOWN) \
+    KEY_NAME(KEY_LEFT_UP) KEY_NAME(KEY_LEFT_DOWN) KEY_NAME(KEY_ROOT_MENU) KEY_NAME(KEY_MEDIA_TOP_MENU) \
+    KEY_NAME(KEY_NUMERIC_11) KEY_NAME(KEY_NUMERIC_12) KEY_NAME(KEY_AUDIO_DESC) KEY_NAME(KEY_3D_MODE) \
+    KEY_NAME(KEY_NEXT_FAVORITE) KEY_NAME(KEY_STOP_RECORD) KEY_NAME(KEY_PAUSE_RECORD) KEY_NAME(KEY_VOD) \
+    KEY_NAME(KEY_UNMUTE) KEY_NAME(KEY_FASTREVERSE) KEY_NAME(KEY_SLOWREVERSE) KEY_NAME(KEY_DATA) \
+    KEY_NAME(KEY_ONSCREEN_KEYBOARD) KEY_NAME(KEY_PRIVACY_SCREEN_TOGGLE) KEY_NAME(KEY_SELECTIVE_SCREENSHOT) KEY_NAME(KEY_NEXT_ELEMENT) \
+    KEY_NAME(KEY_PREVIOUS_ELEMENT) KEY_NAME(KEY_AUTOPILOT_ENGAGE_TOGGLE) KEY_NAME(KEY_MARK_WAYPOINT) KEY_NAME(KEY_SOS) \
+    KEY_NAME(KEY_NAV_CHART) KEY_NAME(KEY_FISHING_CHART) KEY_NAME(KEY_SINGLE_RANGE_RADAR) KEY_NAME(KEY_DUAL_RANGE_RADAR) \
+    KEY_NAME(KEY_RADAR_OVERLAY) KEY_NAME(KEY_TRADITIONAL_SONAR) KEY_NAME(KEY_CLEARVU_SONAR) KEY_NAME(KEY_SIDEVU_SONAR) \
+    KEY_NAME(KEY_NAV_INFO) KEY_NAME(KEY_BRIGHTNESS_MENU) KEY_NAME(KEY_MACRO1) KEY_NAME(KEY_MACRO2) \
+    KEY_NAME(KEY_MACRO3) KEY_NAME(KEY_MACRO4) KEY_NAME(KEY_MACRO5) KEY_NAME(KEY_MACRO6) \
+    KEY_NAME(KEY_MACRO7) KEY_NAME(KEY_MACRO8) KEY_NAME(KEY_MACRO9) KEY_NAME(KEY_MACRO10) \
+    KEY_NAME(KEY_MACRO11) KEY_NAME(KEY_MACRO12) KEY_NAME(KEY_MACRO13) KEY_NAME(KEY_MACRO14) \
+    KEY_NAME(KEY_MACRO15) KEY_NAME(KEY_MACRO16) KEY_NAME(KEY_MACRO17) KEY_NAME(KEY_MACRO18) \
+    KEY_NAME(KEY_MACRO19) KEY_NAME(KEY_MACRO20) KEY_NAME(KEY_MACRO21) KEY_NAME(KEY_MACRO22) \
+    KEY_NAME(KEY_MACRO23) KEY_NAME(KEY_MACRO24) KEY_NAME(KEY_MACRO25) KEY_NAME(KEY_MACRO26) \
+    KEY_NAME(KEY_MACRO27) KEY_NAME(KEY_MACRO28) KEY_NAME(KEY_MACRO29) KEY_NAME(KEY_MACRO30) \
+    KEY_NAME(KEY_MACRO_RECORD_START) KEY_NAME(KEY_MACRO_RECORD_STOP) KEY_NAME(KEY_MACRO_PRESET_CYCLE) KEY_NAME(KEY_MACRO_PRESET1) \
+    KEY_NAME(KEY_MACRO_PRESET2) KEY_NAME(KEY_MACRO_PRESET3) KEY_NAME(KEY_KBD_LCD_MENU1) KEY_NAME(KEY_KBD_LCD_MENU2) \
+    KEY_NAME(KEY_KBD_LCD_MENU3) KEY_NAME(KEY_KBD_LCD_MENU4) KEY_NAME(KEY_KBD_LCD_MENU5) KEY_NAME(BTN_TRIGGER_HAPPY) \
+    KEY_NAME(BTN_TRIGGER_HAPPY1) KEY_NAME(BTN_TRIGGER_HAPPY2) KEY_NAME(BTN_TRIGGER_HAPPY3) KEY_NAME(BTN_TRIGGER_HAPPY4) \
+    KEY_NAME(BTN_TRIGGER_HAPPY5) KEY_NAME(BTN_TRIGGER_HAPPY6) KEY_NAME(BTN_TRIGGER_HAPPY7) KEY_NAME(BTN_TRIGGER_HAPPY8) \
+    KEY_NAME(BTN_TRIGGER_HAPPY9) KEY_NAME(BTN_TRIGGER_HAPPY10) KEY_NAME(BTN_TRIGGER_HAPPY11) KEY_NAME(BTN_TRIGGER_HAPPY12) \
+    KEY_NAME(BTN_TRIGGER_HAPPY13) KEY_NAME(BTN_TRIGGER_HAPPY14) KEY_NAME(BTN_TRIGGER_HAPPY15) KEY_NAME(BTN_TRIGGER_HAPPY16) \
+    KEY_NAME(BTN_TRIGGER_HAPPY17) KEY_NAME(BTN_TRIGGER_HAPPY18) KEY_NAME(BTN_TRIGGER_HAPPY19) KEY_NAME(BTN_TRIGGER_HAPPY20) \
+    KEY_NAME(BTN_TRIGGER_HAPPY21) KEY_NAME(BTN_TRIGGER_HAPPY22) KEY_NAME(BTN_TRIGGER_HAPPY23) KEY_NAME(BTN_TRIGGER_HAPPY24) \
+    KEY_NAME(BTN_TRIGGER_HAPPY25) KEY_NAME(BTN_TRIGGER_HAPPY26) KEY_NAME(BTN_TRIGGER_HAPPY27) KEY_NAME(BTN_TRIGGER_HAPPY28) \
+    KEY_NAME(BTN_TRIGGER_HAPPY29) KEY_NAME(BTN_TRIGGER_HAPPY30) KEY_NAME(BTN_TRIGGER_HAPPY31) KEY_NAME(BTN_TRIGGER_HAPPY32) \
+    KEY_NAME(BTN_TRIGGER_HAPPY33) KEY_NAME(BTN_TRIGGER_HAPPY34) KEY_NAME(BTN_TRIGGER_HAPPY35) KEY_NAME(BTN_TRIGGER_HAPPY36) \
+    KEY_NAME(BTN_TRIGGER_HAPPY37) KEY_NAME(BTN_TRIGGER_HAPPY38) KEY_NAME(BTN_TRIGGER_HAPPY39) KEY_NAME(BTN_TRIGGER_HAPPY40)
+
+struct keyName
+{
+    const char* name;
+    uint16_t code;
 };
 
+#define KEY_NAME(name) { #name, name },
+static constexpr keyName keyNames[] = {
+    KEY_NAME_LIST
+    /* Aliases */
+    { "CTRL", KEY_LEFTCTRL }, { "SHIFT", KEY_LEFTSHIFT }, { "ALT", KEY_LEFTALT }, { "ALTGR", KEY_RIGHTALT },
+    { "SUPER", KEY_LEFTMETA }, { "META", KEY_LEFTMETA }, { "WIN", KEY_LEFTMETA }, { "RETURN", KEY_ENTER },
+    { "ESCAPE", KEY_ESC }, { "DEL", KEY_DELETE }, { "INS", KEY_INSERT }, { "PGUP", KEY_PAGEUP }, { "PGDN", KEY_PAGEDOWN },
+};
+#undef KEY_NAME
+
+#define KEY_NAME_COUNT (sizeof(keyNames) / sizeof(keyNames[0]))
+#define KEY_NAME_BUCKETS 256
+#define KEY_NAME_SLOTS 1024
+#define KEY_NAME_BUCKET_LIMIT 16 // Names per bucket, the average is below 3
 
-void Keybinds::printCache()
+static constexpr char upperCase(char c)
 {
-    cout << "Current keybindings: " << endl;
-    cout << "--------------------" << endl;
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+}
+
+/* Skips an optional KEY_ prefix, "KEY_LEFTCTRL" and "leftctrl" are the same name */
+static constexpr size_t keyNameStart(const char* name, size_t length)
+{
+    return length > 4 && upperCase(name[0]) == 'K' && upperCase(name[1]) == 'E' && upperCase(name[2]) == 'Y' && name[3] == '_' ? 4 : 0;
+}
+
+static constexpr size_t constLength(const char* text)
+{
+    size_t length = 0;
+    while(text[length])
+    {
+        length++;
+    }
+    return length;
+}
+
+/* FNV-1a over the normalized name, mixed with a seed */
+static constexpr uint32_t keyNameHash(const char* name, size_t length, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+    for(size_t i = keyNameStart(name, length); i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)upperCase(name[i])) * 16777619u;
+    }
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    return hash ^ (hash >> 12);
+}
+
+static constexpr bool keyNameEquals(const char* a, size_t aLength, const char* b, size_t bLength)
+{
+    size_t i = keyNameStart(a, aLength);
+    size_t j = keyNameStart(b, bLength);
+    if(aLength - i != bLength - j)
+    {
+        return false;
+    }
+    for(; i < aLength; i++, j++)
+    {
+        if(upperCase(a[i]) != upperCase(b[j]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct keyNameTable
+{
+    uint16_t seeds[KEY_NAME_BUCKETS];
+    /* Index into keyNames, -1 for an empty slot */
+    int16_t slots[KEY_NAME_SLOTS];
+    /* Reverse lookup, first name listed for every code */
+    int16_t names[KEY_CNT];
+};
+
+static constexpr keyNameTable buildKeyNameTable()
+{
+    keyNameTable table = {};
+    uint16_t bucketOf[KEY_NAME_COUNT] = {};
+    uint16_t bucketSize[KEY_NAME_BUCKETS] = {};
+    for(size_t slot = 0; slot < KEY_NAME_SLOTS; slot++)
+    {
+        table.slots[slot] = -1;
+    }
+    for(size_t code = 0; code < KEY_CNT; code++)
+    {
+        table.names[code] = -1;
+    }
+    for(size_t n = 0; n < KEY_NAME_COUNT; n++)
+    {
+        const char* name = keyNames[n].name;
+        bucketOf[n] = keyNameHash(name, constLength(name), 0) % KEY_NAME_BUCKETS;
+        bucketSize[bucketOf[n]]++;
+        if(table.names[keyNames[n].code] < 0)
+        {
+            table.names[keyNames[n].code] = n;
+        }
+    }
+
+    /* Largest buckets first, while the table is still empty enough to place them */
+    uint16_t largest = 0;
+    for(size_t b = 0; b < KEY_NAME_BUCKETS; b++)
+    {
+        largest = bucketSize[b] > largest ? bucketSize[b] : largest;
+    }
+    for(uint16_t size = largest; size > 0; size--)
+    {
+        for(size_t b = 0; b < KEY_NAME_BUCKETS; b++)
+        {
+            if(bucketSize[b] != size)
+            {
+                continue;
+            }
+            for(uint16_t seed = 1; ; seed++)
+            {
+                /* Every name of the bucket needs its own free slot */
+                uint16_t chosen[KEY_NAME_BUCKET_LIMIT] = {};
+                size_t placed = 0;
+                bool fits = true;
+                for(size_t n = 0; n < KEY_NAME_COUNT && fits && placed < KEY_NAME_BUCKET_LIMIT; n++)
+                {
+                    if(bucketOf[n] != b)
+                    {
+                        continue;
+                    }
+                    const char* name = keyNames[n].name;
+                    uint16_t slot = keyNameHash(name, constLength(name), seed) % KEY_NAME_SLOTS;
+                    fits = table.slots[slot] < 0;
+                    for(size_t p = 0; p < placed && fits; p++)
+                    {
+                        fits = chosen[p] != slot;
+                    }
+                    chosen[placed++] = slot;
+                }
+                if(!fits)
+                {
+                    continue;
+                }
+                placed = 0;
+                for(size_t n = 0; n < KEY_NAME_COUNT; n++)
+                {
+                    if(bucketOf[n] == b)
+                    {
+                        table.slots[chosen[placed++]] = n;
+                    }
+                }
+                table.seeds[b] = seed;
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+static constexpr keyNameTable keyNameIndex = buildKeyNameTable();
+
+/* Key code for a name, -1 if unknown */
+static constexpr int keyCode(const char* name, size_t length)
+{
+    uint16_t seed = keyNameIndex.seeds[keyNameHash(name, length, 0) % KEY_NAME_BUCKETS];
+    int16_t n = keyNameIndex.slots[keyNameHash(name, length, seed) % KEY_NAME_SLOTS];
+    if(n < 0 || !keyNameEquals(name, length, keyNames[n].name, constLength(keyNames[n].name)))
+    {
+        return -1;
+    }
+    return keyNames[n].code;
+}
+
+#define KEY_CLASS_COUNT 4
+#define KEY_CLASS_FIRST (KEY_CNT + 16) // Above the pseudo codes of the trigger, output and hotstring signatures
+#define KEY_CLASS_END (KEY_CLASS_FIRST + KEY_CLASS_COUNT)
+
+static constexpr uint16_t classKeys[KEY_CLASS_COUNT][2] = {
+    { KEY_LEFTCTRL, KEY_RIGHTCTRL }, { KEY_LEFTSHIFT, KEY_RIGHTSHIFT }, { KEY_LEFTALT, KEY_RIGHTALT }, { KEY_LEFTMETA, KEY_RIGHTMETA },
+};
+static constexpr keyName classNames[] = {
+    { "ctrl", KEY_CLASS_FIRST }, { "shift", KEY_CLASS_FIRST + 1 }, { "alt", KEY_CLASS_FIRST + 2 }, { "super", KEY_CLASS_FIRST + 3 },
+    { "meta", KEY_CLASS_FIRST + 3 }, { "win", KEY_CLASS_FIRST + 3 },
+};
+
+/* Pseudo code of a modifier class name, -1 if the name is not a class */
+static int keyClassCode(const char* name, size_t length)
+{
+    for(const keyName& named : classNames)
+    {
+        if(keyNameEquals(name, length, named.name, constLength(named.name)))
+        {
+            return named.code;
+        }
+    }
+    return -1;
+}
+
+/* Class of a left or right modifier key, -1 for any other key */
+static inline int keyClass(int code)
+{
+    for(int c = 0; c < KEY_CLASS_COUNT; c++)
+    {
+        if(code == classKeys[c][0] || code == classKeys[c][1])
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+/* Name for a key code, without the KEY_ prefix, nullptr if the code has no name */
+static const char* keyCodeName(int code)
+{
+    if(code >= KEY_CLASS_FIRST && code < KEY_CLASS_END)
+    {
+        return classNames[code - KEY_CLASS_FIRST].name;
+    }
+    if(code < 0 || code >= KEY_CNT || keyNameIndex.names[code] < 0)
+    {
+        return nullptr;
+    }
+    const char* name = keyNames[keyNameIndex.names[code]].name;
+    return name + keyNameStart(name, constLength(name));
+}
+
+static_assert(keyCode("KEY_LEFTCTRL", 12) == KEY_LEFTCTRL && keyCode("right", 5) == KEY_RIGHT && keyCode("ctrl", 4) == KEY_LEFTCTRL,
+    "key name table does not resolve");
+
+
+/*
+    --------------------
+    | Output Device    |
+    --------------------
+*/
+
+/*
+    - With --grab the device is exclusively ours, other applications only see what is written to its virtual clone (uinput)
+        - Everything the keybinds don't hold back or replace is passed through unchanged
+    - Events are copied once into a fixed frame array and the frame is written with a single write() when it ends
+      with its SYN_REPORT, nothing is allocated on the way
+    - Replays have no device to clone, the key events are printed as [<] <time> <key> <value> instead
+    - "emit" keybinds go through a second device, a virtual keyboard created once at startup with every key,
+      a whole tap (presses, SYN_REPORT, releases, SYN_REPORT) is a single writev()
+*/
+
+#define OUTPUT_FRAME_MAX 64 // Events per write, longer frames are written in parts
+#define MAX_EMIT_KEYS 8 // Keys of one tap(), the same as MAX_CHORD_KEYS
+
+class OutputDevice
+{
+    public:
+        ~OutputDevice();
+        /* Clone of the grabbed device, same name, ids and capabilities */
+        bool open(const struct libevdev* device);
+        /* Virtual keyboard that can send every key */
+        bool create(const char* name);
+        /* Adds an event to the current frame, a SYN_REPORT ends the frame and writes it */
+        void push(const struct input_event& ev);
+        /* Key event sent by the keybinds themselves */
+        void emit(int code, int value);
+        /* Ends the current frame, if anything was added to it */
+        void flush();
+        /* Presses the keys in order and releases them in reverse, as two frames written at once */
+        void tap(const uint16_t* keys, int keyCount);
+        /* Whole frames written at once */
+        void send(const struct input_event* events, int eventCount);
+
+        /* Print the key events instead of writing them, for replays */
+        bool print = false;
+        Clock* clock = nullptr;
+    private:
+        struct libevdev_uinput* uinput = nullptr;
+        int fd = -1;
+        struct input_event frame[OUTPUT_FRAME_MAX];
+        int count = 0;
+
+        void write();
+        Logger logger;
+};
+
+bool OutputDevice::open(const struct libevdev* device)
+{
+    if(libevdev_uinput_create_from_device(device, LIBEVDEV_UINPUT_OPEN_MANAGED, &uinput) < 0)
+    {
+        return false;
+    }
+    fd = libevdev_uinput_get_fd(uinput);
+    return true;
+}
+
+bool OutputDevice::create(const char* name)
+{
+    struct libevdev* device = libevdev_new();
+    libevdev_set_name(device, name);
+    libevdev_set_id_bustype(device, BUS_VIRTUAL);
+    libevdev_enable_event_type(device, EV_KEY);
+    for(int code = 1; code < KEY_CNT; code++)
+    {
+        /* Keys only, mouse and joystick buttons would get it classified as something else than a keyboard */
+        if(code < BTN_MISC || (code >= KEY_OK && code < BTN_DPAD_UP) || (code > BTN_DPAD_RIGHT && code < BTN_TRIGGER_HAPPY))
+        {
+            libevdev_enable_event_code(device, EV_KEY, code, nullptr);
+        }
+    }
+    bool created = open(device);
+    libevdev_free(device);
+    return created;
+}
+
+OutputDevice::~OutputDevice()
+{
+    if(uinput)
+    {
+        libevdev_uinput_destroy(uinput);
+    }
+}
+
+void OutputDevice::push(const struct input_event& ev)
+{
+    frame[count++] = ev;
+    if(count == OUTPUT_FRAME_MAX || (ev.type == EV_SYN && ev.code == SYN_REPORT))
+    {
+        write();
+    }
+}
+
+void OutputDevice::emit(int code, int value)
+{
+    /* The kernel stamps events written to uinput with the time they were written */
+    struct input_event ev = {};
+    ev.type = EV_KEY;
+    ev.code = code;
+    ev.value = value;
+    push(ev);
+}
+
+void OutputDevice::flush()
+{
+    if(count > 0)
+    {
+        struct input_event ev = {};
+        ev.type = EV_SYN;
+        ev.code = SYN_REPORT;
+        push(ev);
+    }
+}
+
+void OutputDevice::tap(const uint16_t* keys, int keyCount)
+{
+    flush();
+    struct input_event press[MAX_EMIT_KEYS + 1] = {};
+    struct input_event release[MAX_EMIT_KEYS + 1] = {};
+    for(int k = 0; k < keyCount; k++)
+    {
+        press[k].type = release[k].type = EV_KEY;
+        press[k].code = keys[k];
+        release[k].code = keys[keyCount - 1 - k];
+        press[k].value = 1;
+    }
+    press[keyCount].type = release[keyCount].type = EV_SYN;
+    press[keyCount].code = release[keyCount].code = SYN_REPORT;
+    if(print || fd < 0)
+    {
+        for(int k = 0; k <= keyCount; k++)
+        {
+            push(press[k]);
+        }
+        for(int k = 0; k <= keyCount; k++)
+        {
+            push(release[k]);
+        }
+        return;
+    }
+    struct iovec frames[2] = {{press, (keyCount + 1) * sizeof(press[0])}, {release, (keyCount + 1) * sizeof(release[0])}};
+    if(writev(fd, frames, 2) != (ssize_t)(frames[0].iov_len + frames[1].iov_len))
+    {
+        logger.error("Failed to write to the output device");
+    }
+}
+
+void OutputDevice::send(const struct input_event* events, int eventCount)
+{
+    flush();
+    if(print || fd < 0)
+    {
+        for(int e = 0; e < eventCount; e++)
+        {
+            push(events[e]);
+        }
+        return;
+    }
+    if(::write(fd, events, eventCount * sizeof(events[0])) != (ssize_t)(eventCount * sizeof(events[0])))
+    {
+        logger.error("Failed to write to the output device");
+    }
+}
+
+void OutputDevice::write()
+{
+    if(print)
+    {
+        for(int i = 0; i < count; i++)
+        {
+            if(frame[i].type == EV_KEY)
+            {
+                const char* name = keyCodeName(frame[i].code);
+                cout << "[<] " << clock->now() << " " << (name ? string(name) : to_string(frame[i].code)) << " " << frame[i].value << endl;
+            }
+        }
+    }
+    else if(fd >= 0 && ::write(fd, frame, count * sizeof(frame[0])) != (ssize_t)(count * sizeof(frame[0])))
+    {
+        logger.error("Failed to write to the output device");
+    }
+    count = 0;
+}
+
+
+/*
+    --------------------
+    | Macros           |
+    --------------------
+*/
+
+/*
+    - A "record" keybind starts recording the keys of the device into a macro, the next record keybind stops it
+        - Every press and release keeps its kernel timestamp, relative to the first one recorded
+        - Keys that were already down when the recording started are left out, so are the keys of the keybind stopping it
+    - A "play" keybind plays a macro through the virtual keyboard of the "emit" keybinds, faster or slower with a speed
+        - Nothing waits for it: the owner wakes up at next() through the timerfd of the keybinds and calls advance()
+        - Each frame is due at the start of the playback plus its offset divided by the speed, late wakeups don't add up,
+          every frame due at a wakeup is sent in that wakeup
+        - Playing a macro stops the one that is playing, the keys it still holds are released first
+    - Macros are kept in memory until the daemon exits, by the hash of their name
+*/
+
+#define MACRO_RESERVE 4096 // Events reserved when a recording starts
+
+class Macros
+{
+    public:
+        void startRecording(uint64_t name);
+        /* Stores the recording, keys of the stopping keybind that are still down are dropped */
+        void stopRecording(const uint16_t* keys, int keyCount);
+        void record(const struct input_event& ev);
+        bool recording() const
+        {
+            return recordingName != 0;
+        }
+        /* speed in percent, false when the macro was never recorded */
+        bool play(uint64_t name, int speed, long long now, OutputDevice& output);
+        void stop();
+        /* Clock time the next frame is due, -1 when nothing is playing */
+        long long next() const
+        {
+            return playing ? startedAt + (*playing)[position].at * 100 / speed : -1;
+        }
+        /* Sends every frame due at now */
+        void advance(long long now);
+    private:
+        struct macroEvent
+        {
+            /* Microseconds after the first event */
+            long long at;
+            uint16_t code;
+            int32_t value;
+        };
+        unordered_map<uint64_t, vector<macroEvent>> macros;
+
+        uint64_t recordingName = 0;
+        vector<macroEvent> take;
+        long long firstAt = 0;
+        /* Keys whose press is in take */
+        bool down[KEY_CNT] = {};
+
+        const vector<macroEvent>* playing = nullptr;
+        uint64_t playingName = 0;
+        size_t position = 0;
+        long long startedAt = 0;
+        int speed = 100;
+        OutputDevice* output = nullptr;
+        /* Keys pressed by the playback and not released yet */
+        bool pressed[KEY_CNT] = {};
+};
+
+void Macros::startRecording(uint64_t name)
+{
+    recordingName = name;
+    take.clear();
+    take.reserve(MACRO_RESERVE);
+    fill(down, down + KEY_CNT, false);
+}
+
+void Macros::stopRecording(const uint16_t* keys, int keyCount)
+{
+    for(int k = 0; k < keyCount; k++)
+    {
+        /* A modifier class is whichever of its keys is down */
+        bool modifierClass = keys[k] >= KEY_CLASS_FIRST;
+        for(int member = 0; member < (modifierClass ? 2 : 1); member++)
+        {
+            uint16_t key = modifierClass ? classKeys[keys[k] - KEY_CLASS_FIRST][member] : keys[k];
+            if(!down[key])
+            {
+                continue;
+            }
+            /* Still down, so the last event of the key is the press that was part of the keybind */
+            for(size_t e = take.size(); e-- > 0;)
+            {
+                if(take[e].code == key)
+                {
+                    take.erase(take.begin() + e);
+                    break;
+                }
+            }
+            down[key] = false;
+        }
+    }
+    if(playingName == recordingName)
+    {
+        stop();
+    }
+    if(!take.empty())
+    {
+        long long first = take[0].at;
+        for(macroEvent& e : take)
+        {
+            e.at -= first;
+        }
+    }
+    macros[recordingName].swap(take);
+    recordingName = 0;
+}
+
+void Macros::record(const struct input_event& ev)
+{
+    /* Autorepeats are left to whoever receives the playback, like for a real keyboard */
+    if(!recording() || ev.value == 2 || (ev.value == 0 && !down[ev.code]))
+    {
+        return;
+    }
+    long long eventUs = ev.time.tv_sec * 1000000LL + ev.time.tv_usec;
+    down[ev.code] = ev.value == 1;
+    take.push_back({eventUs, ev.code, ev.value});
+}
+
+bool Macros::play(uint64_t name, int _speed, long long now, OutputDevice& _output)
+{
+    stop();
+    auto found = macros.find(name);
+    if(found == macros.end() || found->second.empty())
+    {
+        return false;
+    }
+    playing = &found->second;
+    playingName = name;
+    position = 0;
+    startedAt = now;
+    speed = _speed;
+    output = &_output;
+    return true;
+}
+
+void Macros::stop()
+{
+    if(!playing)
+    {
+        return;
+    }
+    for(int code = 0; code < KEY_CNT; code++)
+    {
+        if(pressed[code])
+        {
+            output->emit(code, 0);
+            pressed[code] = false;
+        }
+    }
+    output->flush();
+    playing = nullptr;
+    playingName = 0;
+}
+
+void Macros::advance(long long now)
+{
+    /* Events with the same timestamp were one frame of the device and are sent as one frame */
+    while(playing && next() <= now)
+    {
+        long long at = (*playing)[position].at;
+        for(; position < playing->size() && (*playing)[position].at == at; position++)
+        {
+            const macroEvent& e = (*playing)[position];
+            output->emit(e.code, e.value);
+            pressed[e.code] = e.value == 1;
+        }
+        output->flush();
+        if(position == playing->size())
+        {
+            stop();
+        }
+    }
+}
+
+
+/*
+    --------------------
+    | Keyboard Layout  |
+    --------------------
+*/
+
+/*
+    - Key codes are the same on every layout, characters are not: 'a' is KEY_Q on AZERTY
+    - The layout is two tables, filled once and then only indexed:
+        - the character typed by every key at every level (plain, shift, altgr, shift+altgr)
+        - the key and level typing a character, an array for ASCII and a hash map for the rest,
+          the lowest level and then the lowest key code wins
+    - The US layout is built in, --keymap loads an xkb keymap file through libxkbcommon instead
+        - Only when built with HAVE_XKBCOMMON (-DHAVE_XKBCOMMON -lxkbcommon), the daemon doesn't depend on it otherwise
+        - The keymap is compiled and every key is looked up at every level once, nothing touches xkb after that
+        - `xkbcli compile-keymap --layout fr > fr.xkb` writes a keymap file
+*/
+
+#define LAYOUT_LEVELS 4
+#define LAYOUT_SHIFT 1 // Level bits
+#define LAYOUT_ALTGR 2
+#define LAYOUT_KEYS 256 // Key codes that can type a character
+
+struct layoutKey
+{
+    char plain;
+    char shifted;
+    uint16_t code;
+};
+
+static constexpr layoutKey usLayout[] = {
+    {'1', '!', KEY_1}, {'2', '@', KEY_2}, {'3', '#', KEY_3}, {'4', '$', KEY_4}, {'5', '%', KEY_5},
+    {'6', '^', KEY_6}, {'7', '&', KEY_7}, {'8', '*', KEY_8}, {'9', '(', KEY_9}, {'0', ')', KEY_0},
+    {'-', '_', KEY_MINUS}, {'=', '+', KEY_EQUAL}, {'[', '{', KEY_LEFTBRACE}, {']', '}', KEY_RIGHTBRACE},
+    {';', ':', KEY_SEMICOLON}, {'\'', '"', KEY_APOSTROPHE}, {'`', '~', KEY_GRAVE}, {'\\', '|', KEY_BACKSLASH},
+    {',', '<', KEY_COMMA}, {'.', '>', KEY_DOT}, {'/', '?', KEY_SLASH},
+    {'a', 'A', KEY_A}, {'b', 'B', KEY_B}, {'c', 'C', KEY_C}, {'d', 'D', KEY_D}, {'e', 'E', KEY_E},
+    {'f', 'F', KEY_F}, {'g', 'G', KEY_G}, {'h', 'H', KEY_H}, {'i', 'I', KEY_I}, {'j', 'J', KEY_J},
+    {'k', 'K', KEY_K}, {'l', 'L', KEY_L}, {'m', 'M', KEY_M}, {'n', 'N', KEY_N}, {'o', 'O', KEY_O},
+    {'p', 'P', KEY_P}, {'q', 'Q', KEY_Q}, {'r', 'R', KEY_R}, {'s', 'S', KEY_S}, {'t', 'T', KEY_T},
+    {'u', 'U', KEY_U}, {'v', 'V', KEY_V}, {'w', 'W', KEY_W}, {'x', 'X', KEY_X}, {'y', 'Y', KEY_Y},
+    {'z', 'Z', KEY_Z}, {' ', ' ', KEY_SPACE}, {'\n', '\n', KEY_ENTER}, {'\t', '\t', KEY_TAB},
+};
+
+/* Decodes one UTF-8 character, returns its length, 0 when the bytes are not valid UTF-8 */
+static int decodeUtf8(const char* text, size_t length, uint32_t& c)
+{
+    if(length == 0)
+    {
+        return 0;
+    }
+    unsigned char lead = text[0];
+    int extra = lead < 0x80 ? 0 : (lead & 0xE0) == 0xC0 ? 1 : (lead & 0xF0) == 0xE0 ? 2 : (lead & 0xF8) == 0xF0 ? 3 : -1;
+    if(extra < 0 || (size_t)extra >= length)
+    {
+        return 0;
+    }
+    c = extra == 0 ? lead : extra == 1 ? lead & 0x1F : extra == 2 ? lead & 0x0F : lead & 0x07;
+    for(int k = 1; k <= extra; k++)
+    {
+        if(((unsigned char)text[k] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+        c = c << 6 | (text[k] & 0x3F);
+    }
+    return extra + 1;
+}
+
+class KeyboardLayout
+{
+    public:
+        /* The US layout */
+        KeyboardLayout();
+        /* Replaces the tables with the ones of an xkb keymap file, error is set when it fails */
+        bool load(const char* path, string& error);
+        /* Character typed by a key at a level, 0 for none */
+        uint32_t character(int code, int level) const
+        {
+            return code < LAYOUT_KEYS ? characters[level][code] : 0;
+        }
+        /* Key code typing a character, its level << 16 on top, 0 when no key types it */
+        uint32_t key(uint32_t c) const
+        {
+            if(c < 128)
+            {
+                return ascii[c];
+            }
+            auto found = others.find(c);
+            return found == others.end() ? 0 : found->second;
+        }
+        /* Identity of the tables, 0 for the US layout, keybinds resolved through them are cached per layout */
+        uint64_t hash = 0;
+    private:
+        uint32_t characters[LAYOUT_LEVELS][LAYOUT_KEYS] = {};
+        uint32_t ascii[128] = {};
+        unordered_map<uint32_t, uint32_t> others;
+        void index();
+};
+
+KeyboardLayout::KeyboardLayout()
+{
+    for(const layoutKey& key : usLayout)
+    {
+        characters[0][key.code] = key.plain;
+        characters[LAYOUT_SHIFT][key.code] = key.shifted;
+    }
+    index();
+}
+
+void KeyboardLayout::index()
+{
+    fill(ascii, ascii + 128, 0);
+    others.clear();
+    for(int level = 0; level < LAYOUT_LEVELS; level++)
+    {
+        for(int code = 0; code < LAYOUT_KEYS; code++)
+        {
+            uint32_t c = characters[level][code];
+            uint32_t typed = code | level << 16;
+            if(c == 0 || (c < 128 && ascii[c] != 0))
+            {
+                continue;
+            }
+            if(c < 128)
+            {
+                ascii[c] = typed;
+            }
+            else
+            {
+                others.emplace(c, typed);
+            }
+        }
+    }
+}
+
+bool KeyboardLayout::load(const char* path, string& error)
+{
+#ifdef HAVE_XKBCOMMON
+    FILE* file = fopen(path, "r");
+    if(!file)
+    {
+        error = "Unable to open keymap: " + string(path);
+        return false;
+    }
+    struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    struct xkb_keymap* keymap = context ? xkb_keymap_new_from_file(context, file, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS) : nullptr;
+    fclose(file);
+    if(!keymap)
+    {
+        xkb_context_unref(context);
+        error = "Unable to compile keymap: " + string(path);
+        return false;
+    }
+
+    /* The state is set to the modifiers of each level in turn, AltGr is ISO_Level3_Shift on Mod5 in the usual keymaps */
+    xkb_mod_index_t shift = xkb_keymap_mod_get_index(keymap, XKB_MOD_NAME_SHIFT);
+    xkb_mod_index_t altgr = xkb_keymap_mod_get_index(keymap, "Mod5");
+    struct xkb_state* state = xkb_state_new(keymap);
+    hash = 14695981039346656037ULL; // FNV-1a
+    for(int level = 0; level < LAYOUT_LEVELS; level++)
+    {
+        xkb_mod_mask_t mask = ((level & LAYOUT_SHIFT) && shift != XKB_MOD_INVALID ? 1u << shift : 0)
+            | ((level & LAYOUT_ALTGR) && altgr != XKB_MOD_INVALID ? 1u << altgr : 0);
+        xkb_state_update_mask(state, mask, 0, 0, 0, 0, 0);
+        for(int code = 0; code < LAYOUT_KEYS; code++)
+        {
+            /* xkb key codes are evdev codes + 8, control characters other than enter and tab type nothing */
+            uint32_t c = xkb_state_key_get_utf32(state, code + 8);
+            c = c == '\r' ? '\n' : c;
+            characters[level][code] = (c < ' ' && c != '\n' && c != '\t') || c == 0x7F ? 0 : c;
+            hash = (hash ^ characters[level][code]) * 1099511628211ULL;
+        }
+    }
+    xkb_state_unref(state);
+    xkb_keymap_unref(keymap);
+    xkb_context_unref(context);
+    index();
+    return true;
+#else
+    (void)path;
+    error = "--keymap needs xkbcommon, build with -DHAVE_XKBCOMMON -lxkbcommon";
+    return false;
+#endif
+}
+
+
+/*
+    --------------------
+    | Typing           |
+    --------------------
+*/
+
+/*
+    - A "type" keybind types its text through the virtual keyboard of the "emit" keybinds, "typeFile" types the contents
+      of a file, read when the keybind runs so passwords stay out of keybinds.json and its cache
+    - Characters are looked up in the keyboard layout: the key, and the level it is on
+        - Shift and AltGr are pressed once for a run of characters on the same level
+        - Anything else is typed as ctrl+shift+u, its code point in hex and space, the unicode input of GTK and IBus
+    - The text is translated into frames up front, they go out in batches of whole frames with one write() per batch,
+      a batch per millisecond on the timer of the keybinds
+        - evdev buffers 64 events per reader of a keyboard, a single write of the whole text would overflow it before
+          the compositor gets to read it and the keys would be dropped (SYN_DROPPED)
+        - 1 KB of lowercase text is about 90 batches
+    - Text typed while typing is queued behind it
+    - Nothing is sent while modifiers are held, the keys of the keybind would apply to the typed keys (ctrl+alt+K instead of K),
+      typing starts when the last one is released
+*/
+
+#define TYPE_BATCH_EVENTS 48 // Below the evdev buffer of 64 events
+#define TYPE_INTERVAL_US 1000
+class Typist
+{
+    public:
+        /* Queues the keys of UTF-8 text, after erasing the characters before it with backspace */
+        void type(const char* text, size_t length, long long now, OutputDevice& output, const KeyboardLayout& layout, int erase = 0);
+        /* Clock time the next batch is due, -1 when nothing is queued or modifiers are held */
+        long long next() const
+        {
+            return position < events.size() && !waiting ? due : -1;
+        }
+        /* Whether modifiers are held on the keyboard, called when that changes */
+        void modifiersHeld(bool held, long long now)
+        {
+            due = waiting && !held ? max(due, now) : due;
+            waiting = held;
+        }
+        /* Sends the batch due at now */
+        void advance(long long now);
+    private:
+        vector<struct input_event> events;
+        size_t position = 0;
+        long long due = 0;
+        bool waiting = false;
+        OutputDevice* output = nullptr;
+        const KeyboardLayout* layout = nullptr;
+        /* Level the modifiers pressed so far are on */
+        int level = 0;
+
+        void key(int code, int value);
+        void frame();
+        void tap(int code);
+        void setLevel(int to);
+        void codePoint(uint32_t c);
+};
+
+void Typist::key(int code, int value)
+{
+    struct input_event ev = {};
+    ev.type = EV_KEY;
+    ev.code = code;
+    ev.value = value;
+    events.push_back(ev);
+}
+
+void Typist::frame()
+{
+    struct input_event ev = {};
+    ev.type = EV_SYN;
+    ev.code = SYN_REPORT;
+    events.push_back(ev);
+}
+
+void Typist::tap(int code)
+{
+    key(code, 1);
+    frame();
+    key(code, 0);
+    frame();
+}
+
+void Typist::setLevel(int to)
+{
+    if(level == to)
+    {
+        return;
+    }
+    if((level ^ to) & LAYOUT_SHIFT)
+    {
+        key(KEY_LEFTSHIFT, (to & LAYOUT_SHIFT) != 0);
+    }
+    if((level ^ to) & LAYOUT_ALTGR)
+    {
+        key(KEY_RIGHTALT, (to & LAYOUT_ALTGR) != 0);
+    }
+    frame();
+    level = to;
+}
+
+void Typist::codePoint(uint32_t c)
+{
+    uint32_t typed = layout->key(c);
+    if(typed)
+    {
+        setLevel(typed >> 16);
+        tap(typed & 0xFFFF);
+        return;
+    }
+    if(c < ' ' || c == 0x7F)
+    {
+        return;
+    }
+    /* ctrl+shift+u 1f600 space */
+    setLevel(0);
+    key(KEY_LEFTCTRL, 1);
+    key(KEY_LEFTSHIFT, 1);
+    key(KEY_U, 1);
+    frame();
+    key(KEY_U, 0);
+    key(KEY_LEFTSHIFT, 0);
+    key(KEY_LEFTCTRL, 0);
+    frame();
+    char hex[8];
+    int digits = snprintf(hex, sizeof(hex), "%x", c);
+    for(int d = 0; d < digits && layout->key(hex[d]); d++)
+    {
+        codePoint(hex[d]);
+    }
+    setLevel(0);
+    tap(KEY_SPACE);
+}
+
+void Typist::type(const char* text, size_t length, long long now, OutputDevice& _output, const KeyboardLayout& _layout, int erase)
+{
+    if(position == events.size())
+    {
+        events.clear();
+        position = 0;
+        due = now;
+    }
+    output = &_output;
+    layout = &_layout;
+    for(int e = 0; e < erase; e++)
+    {
+        tap(KEY_BACKSPACE);
+    }
+    for(size_t i = 0; i < length;)
+    {
+        /* Invalid bytes are skipped */
+        uint32_t c;
+        int bytes = decodeUtf8(text + i, length - i, c);
+        if(bytes > 0)
+        {
+            codePoint(c);
+        }
+        i += max(bytes, 1);
+    }
+    setLevel(0);
+}
+
+void Typist::advance(long long now)
+{
+    if(next() < 0 || due > now)
+    {
+        return;
+    }
+    /* Up to the last frame that fits, a single frame is never split */
+    size_t end = min(position + TYPE_BATCH_EVENTS, events.size());
+    while(end < events.size() && end > position && !(events[end - 1].type == EV_SYN && events[end - 1].code == SYN_REPORT))
+    {
+        end--;
+    }
+    output->send(&events[position], end - position);
+    position = end;
+    due = now + TYPE_INTERVAL_US;
+}
+
+
+/*
+    --------------------
+    | Keybinds Class   |
+    --------------------
+*/
+
+#define MAX_CHORD_KEYS 8
+#define NO_ACTION UINT32_MAX
+#define REMOVED_ACTIONS (UINT32_MAX - 1) // Slot whose keybind was removed by an incremental reload
+#define RELOAD_SETTLE_US 50000 // 50ms
+#define PRINT_CACHE_LIMIT 100 // Larger caches are only summarized
+#define MAX_LAYER_DEPTH 16 // Layers stacked on top of the base layer
+#define MAX_INCLUDE_DEPTH 8
+#define DROP_IN_SUFFIX ".d" // keybinds.json --> keybinds.d/*.json
+#define MAX_HOTSTRING_LENGTH 32
+
+/* What a keybind does to the layer stack, besides running its command */
+#define LAYER_NONE 0
+#define LAYER_PUSH 1
+#define LAYER_POP 2
+#define LAYER_TOGGLE 3
+
+/* What a keybind sends through the output device (--grab) */
+#define OUTPUT_NONE 0
+#define OUTPUT_DUAL 1 // Dual-role key: emit[0] when tapped, emit[1] while held
+#define OUTPUT_REMAP 2 // The keys are sent as emit instead
+#define OUTPUT_EMIT 3 // emit is tapped when the keybind runs, matched like a command
+
+/* What a keybind does with the macro named by it */
+#define MACRO_NONE 0
+#define MACRO_RECORD 1 // Starts recording, or stops the recording in progress
+#define MACRO_PLAY 2
+#define MACRO_TYPE 3 // Types the text instead
+#define MACRO_TYPE_FILE 4 // Types the contents of the file named by the text, read when the keybind runs
+#define MAX_MACRO_SPEED 10000 // Percent
+
+/* Which event of a keybind runs it, a keybind can have several and is compiled once per trigger */
+#define TRIGGER_PRESS 0 // The press that completes the keys
+#define TRIGGER_RELEASE 1 // The first release of one of the keys
+#define TRIGGER_REPEAT 2 // Every autorepeat while the keys are held
+#define TRIGGER_TAP 3 // The first release, if no other key was pressed since the keys were complete
+#define TRIGGER_HOLD 4 // The keys held for the hold time without any other key going down or up
+#define TRIGGER_COUNT 5
+
+#define TAP_TERM_US 250000 // 250ms: longest press that still counts as a tap, and longest wait for the next tap
+#define DEFAULT_HOLD_US 500000 // 500ms
+#define DUAL_ROLE_TIMEOUT_US TAP_TERM_US // A dual-role key held this long is a hold
+/* Kinds of the timers of the keybinds */
+#define TIMER_HOLD 0
+#define TIMER_TAPS 1
+#define TIMER_DUAL 2
+
+#define BINARY_CACHE_SUFFIX ".cache"
+#define BINARY_CACHE_MAGIC "KBCACHE"
+#define BINARY_CACHE_VERSION 15
+
+/* FNV-1a, used to detect changed keybinds between reloads */
+static inline uint64_t contentHash(const char* text, size_t length)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for(size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)text[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/*
+    Source hash and checksum of the binary cache, FNV-1a would be too slow for large files
+    - 32 bytes per step in 4 independent lanes so the multiplications overlap
+*/
+static uint64_t bulkHash(const char* data, size_t length)
+{
+    uint64_t lanes[4] = { 0xCBF29CE484222325ULL ^ length, 0x84222325CBF29CE4ULL, 0x9E3779B97F4A7C15ULL, 0xBF58476D1CE4E5B9ULL };
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+        uint64_t words[4];
+        memcpy(words, data + i, 32);
+        for(int lane = 0; lane < 4; lane++)
+        {
+            lanes[lane] = (lanes[lane] ^ words[lane]) * 0x9E3779B97F4A7C15ULL;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+    uint64_t hash = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+    return hash ^ contentHash(data + i, length - i);
+}
+
+/* Read-only mapping of a whole file, for keybinds.json and its binary cache */
+struct mappedFile
+{
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool open(const char* path)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        bool opened = fstat(fd, &info) == 0;
+        size = opened ? info.st_size : 0;
+        if(opened && size > 0)
+        {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+            opened = mapped != MAP_FAILED;
+            data = opened ? (const char*)mapped : nullptr;
+        }
+        else if(opened)
+        {
+            data = "";
+        }
+        close(fd);
+        return opened;
+    }
+    ~mappedFile()
+    {
+        if(data && size > 0)
+        {
+            munmap((void*)data, size);
+        }
+    }
+};
+
+/* Pseudo-random 64 bit value per key code (splitmix64), a set of keys is identified by the sum of its values */
+static inline uint64_t keySignature(int code)
+{
+    uint64_t z = (uint64_t)code + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Added to the signature of every keybind in a named layer, the base layer adds nothing */
+static inline uint64_t layerSignature(const char* name, size_t length)
+{
+    uint64_t z = contentHash(name, length);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (z ^ (z >> 31)) | 1;
+}
+
+static const char* triggerNames[TRIGGER_COUNT] = { "press", "release", "repeat", "tap", "hold" };
+
+/* Added to the signature of every keybind with another trigger than press */
+static inline uint64_t triggerSignature(int trigger)
+{
+    return trigger == TRIGGER_PRESS ? 0 : keySignature(KEY_CNT + trigger);
+}
+
+/* Added to the signature of keybinds that send keys, they are looked up by the output path instead of matched */
+static inline uint64_t outputSignature(int output)
+{
+    return output == OUTPUT_NONE ? 0 : keySignature(KEY_CNT + TRIGGER_COUNT + output);
+}
+
+/* Signature of a hotstring keybind, it has no keys: the hash of its text stands in for them */
+static inline uint64_t hotstringSignature(const char* text, size_t length)
+{
+    return layerSignature(text, length) + keySignature(KEY_CNT + TRIGGER_COUNT + OUTPUT_EMIT + 1);
+}
+
+static_assert(KEY_CNT + TRIGGER_COUNT + OUTPUT_EMIT + 1 < KEY_CLASS_FIRST, "modifier classes share signatures with triggers or outputs");
+
+class Keybinds
+{
+    private:
+        /* Plain data without pointers, so the cache and index can be written to and mapped from the binary cache */
+        struct action
+        {
+            /* Sum of the keySignature of every key, plus the layer, the trigger and the output */
+            uint64_t signature;
+            /* Hash of everything that is not part of the identity, a different hash means the keybind changed */
+            uint64_t content;
+            /* layerSignature of the layer the keybind is in, 0 for the base layer */
+            uint64_t layer;
+            /* Layer pushed, popped or toggled, 0 with LAYER_POP pops the top layer */
+            uint64_t target;
+            /* Next action with the same signature, NO_ACTION terminated */
+            uint32_t next;
+            /* Command in the string pool of the table, followed by the text and the hotstring */
+            uint32_t commandOffset;
+            uint32_t commandLength;
+            /* Sorted, without duplicates */
+            uint16_t keys[MAX_CHORD_KEYS];
+            /* Stable identity across reloads: the keys plus the how manieth keybind with these keys it is */
+            uint16_t ordinal;
+            /* Order the keys have to be pressed in, as indices into keys, only used when ordered */
+            uint8_t order[MAX_CHORD_KEYS];
+            /* All keys pressed within this many microseconds of each other, 0 for no limit */
+            uint32_t window;
+            /* Hold keybinds: microseconds the keys have to be held */
+            uint32_t hold;
+            /* Macro name or text typed, see MACRO_ */
+            uint32_t textLength;
+            /* Hotstring keybinds: characters typed that run it, instead of keys */
+            uint8_t hotstringLength;
+            /* Playback speed in percent */
+            uint16_t speed;
+            uint8_t macroOp;
+            /* Keys sent through the output device, see OUTPUT_ */
+            uint16_t emit[MAX_CHORD_KEYS];
+            uint8_t emitCount;
+            uint8_t output;
+            uint8_t keyCount;
+            uint8_t layerOp;
+            uint8_t trigger;
+            /* Tap keybinds: number of taps in a row, 0 for every tap */
+            uint8_t taps;
+            bool ordered;
+            /* --grab: the keys that run the keybind still reach other applications */
+            bool passthrough;
+            /* Left behind by an incremental reload, unlinked from the index */
+            bool removed;
+        };
+        struct slot
+        {
+            uint64_t signature;
+            /* First action with this signature, NO_ACTION for an empty slot */
+            uint32_t first;
+            uint32_t padding;
+        };
+        struct table
+        {
+            vector<action> cache;
+            vector<slot> index;
+            uint64_t indexMask = 0;
+            /* Every command, back to back */
+            string strings;
+            /* Names of the layers, one per line */
+            string layers;
+            /* Files included by the source, one per line, as written */
+            string includes;
+            /* Counters and running commands per action, shared with the previous table when the keybind is unchanged */
+            vector<shared_ptr<actionState>> states;
+            /*
+                Translation of every key code, derived from the remaps when the table is published (buildRemap())
+                - Key sent for a key of the base layer remapped to one other key, 0 when it is sent as itself
+                - Remaps of chords, to chords or in a named layer are looked up in the index, only when there are any
+            */
+            vector<uint16_t> remap;
+            bool indexedRemaps = false;
+            /*
+                Aho-Corasick automaton of the hotstrings, built when the table is published (buildHotstrings())
+                - hotstringNext: the next state for every state and character class, failure links already followed,
+                  so a character typed is always a single lookup
+                - hotstringAccept: hotstring keybind typed when the state is reached, the longest one, NO_ACTION for none
+                - Characters that are in no hotstring share class 0, it leads back to the root (state 0)
+            */
+            vector<uint32_t> hotstringNext;
+            vector<uint32_t> hotstringAccept;
+            uint8_t hotstringClass[128] = {};
+            uint32_t hotstringColumns = 0;
+            /* Bit per set of modifier classes some keybind is written with, bit 0 for the keybinds without (buildClassMasks()) */
+            uint16_t classMasks = 1;
+            /* Number of the publish() that made the table current, a table at the address of a freed one is still another table */
+            uint64_t generation = 0;
+
+            string command(const action& cached) const
+            {
+                return strings.substr(cached.commandOffset, cached.commandLength);
+            }
+            const char* text(const action& cached) const
+            {
+                return strings.data() + cached.commandOffset + cached.commandLength;
+            }
+            const char* hotstring(const action& cached) const
+            {
+                return text(cached) + cached.textLength;
+            }
+            /* Length of the strings of an action, copied as one between tables */
+            static size_t stringLength(const action& cached)
+            {
+                return cached.commandLength + cached.textLength + cached.hotstringLength;
+            }
+        };
+        /*
+            - Binary cache: the compiled table of keybinds.json, stored in keybinds.json.cache
+                - Used instead of parsing when the hash of keybinds.json matches the one it was compiled from
+                - Header, then the cache, index, string pool, layer names and includes as they are in memory
+                - One per source file, an edit only recompiles the file that changed
+                - Versioned and checksummed, anything that doesn't match is ignored and rewritten
+        */
+        struct binaryCacheHeader
+        {
+            char magic[8];
+            uint32_t version;
+            /* Layout check, the file is only valid for the build that wrote it */
+            uint16_t actionSize;
+            uint16_t slotSize;
+            uint64_t sourceHash;
+            uint64_t sourceSize;
+            /* bulkHash of everything after the header */
+            uint64_t checksum;
+            uint64_t actionCount;
+            uint64_t indexCapacity;
+            uint64_t stringBytes;
+            uint64_t layerBytes;
+            uint64_t includeBytes;
+        };
+        /*
+            - Cache consists of a vector of actions
+            - Each action consists of the keys of its keybind and a command
+            - The index is an open addressing hash table from keybind signature to the actions with that keybind
+                - Actions with the same keybind are chained in file order, they all fire
+            - For each event received, the signature of the keys held is looked up in the index
+                - One lookup per event regardless of the amount of keybinds, no allocations
+                - The event value picks the trigger, every trigger has its own keys in the index (triggerSignature)
+                  Press and repeat look up the keys held after the event, release and tap the keys held up to it
+            - Layers: every named layer shares the index, its keybinds are keyed by their signature plus the layerSignature
+                - Keybinds can push, pop or toggle layers, the stack holds the layerSignature of each active layer
+                - Matching looks up the held keys in the top layer first, down to the base layer
+                  The first layer with a match wins, keybinds of the layers below are shadowed
+                - Switching layers only changes the stack, one lookup per active layer, no filtering
+            - Taps and holds are decided later, by timers on the clock of the keybinds (see TimerWheel)
+                - Hold: completing the keys schedules a timer per hold time of their hold keybinds,
+                  the ones whose keys are still held unchanged when it expires fire
+                - Taps: a tap of keys that have keybinds for several taps waits up to TAP_TERM_US for the next tap,
+                  then the keybind for the number of taps so far fires. Any other key resolves it right away
+                - Tap keybinds without a number of taps still fire on every tap, without waiting
+            - Grabbed devices (--grab): every event passes through route() on its way to the output device
+                - Dual-role keys are held back until they are resolved: a release is a tap and sends the tap key,
+                  another key pressed or DUAL_ROLE_TIMEOUT_US passing makes it a hold, the hold key is pressed until its release
+                - Remaps: a key remapped to one other key is translated by the flat remap array of the table,
+                  it is sent as that key until its release. Remaps of chords, to chords or in named layers are looked up
+                  in the index like keybinds (outputSignature), the remapped keys are released and the keys of the remap pressed
+                - Keybinds always match the keys of the device, not the keys sent
+                - The press or autorepeat that runs a keybind is not passed on, unless it has passthrough,
+                  after a press the rest of that key (autorepeats and release) is dropped as well.
+                  Keys pressed before it, like the modifiers of the keybind, were already passed on and are released normally
+
+            Example:
+            [
+                {
+                    "keybind": [
+                        {
+                            "key": 28,
+                            "modifier": 0
+                        }
+                    ],
+                    "command": "echo Hello World"
+                }
+            ]
+            This would execute the command "echo Hello World" when the key 28 is pressed
+
+            - The user can dynamically change the keybinds by editing the disk file
+            - The cache is reloaded when the disk file is changed
+                - The new file is diffed against the current table by identity (keys + ordinal)
+                - Only added, removed and changed keybinds are patched into a copy of the table,
+                  unchanged keybinds keep their index entries and their state
+                - A watcher thread compiles the new table off the listener thread
+                - The new table is published with one pointer swap, the listener never sees a half built cache
+                - The old table is freed once the listener is done with it (RCU style, see publish())
+        */
+        /*
+            - Sources: keybinds.json can include other files, and every *.json in keybinds.d/ is loaded after it
+                - { "include": [ "team.json" ], "keybinds": [ ... ] }, relative to the including file
+                - Override order: the includes (in order, before the file including them), the file, the drop-ins by name
+                - A later source replaces the keybinds of an earlier one with the same keys in the same layer,
+                  within one source they all fire as before
+            - Every source is compiled and cached on its own, then the tables are merged into the one that is published
+        */
+        struct sourceSet
+        {
+            vector<table*> parts;
+            vector<string> paths;
+            /* --check: always parse, keep the line of every keybind and count the skipped ones */
+            bool check = false;
+            vector<vector<uint32_t>> lines;
+            unsigned skipped = 0;
+        };
+        /* Paths of the last successful load, watched for changes */
+        vector<string> sources;
+
+        atomic<table*> current{nullptr};
+        /* Incremented before and after every lookup, odd while the listener is reading current */
+        atomic<unsigned long> epoch{0};
+
+        /* 
+            - Keys currently HELD
+                - held[code] makes updates O(1)
+                - heldCount and heldSignature describe the whole set, heldSignature is updated incrementally
+                - A modifier class is held while one of its keys is, with the press of the first one
+            - Used to detect keybinds
+        */
+        bool held[KEY_CLASS_END] = {};
+        long long pressedAt[KEY_CLASS_END] = {}; // Clock time in microseconds, the kernel timestamp of the press for devices
+        /* Arrival order of the presses, exact even for keys in the same frame with the same timestamp */
+        unsigned long pressedSequence[KEY_CLASS_END] = {};
+        unsigned long pressCount = 0;
+        int heldCount = 0;
+        uint64_t heldSignature = 0;
+        /*
+            Held keys canonicalized into modifier classes, updated when a modifier is pressed or released
+            - classDelta[mask]: added to heldSignature, replaces the keys of the classes in mask by their class
+            - Keybinds with class keys are found with one lookup per class mask the table uses (see classMasks)
+        */
+        uint8_t classHeld[KEY_CLASS_COUNT] = {};
+        unsigned heldClasses = 0;
+        uint64_t classDelta[1 << KEY_CLASS_COUNT] = {};
+        void updateClass(int c);
+        bool classMask(const table& active, unsigned mask)
+        {
+            return (active.classMasks >> mask & 1) && (mask & ~heldClasses) == 0;
+        }
+        /* Nothing but autorepeats since the last press, the next release is a tap */
+        bool tapArmed = false;
+        /* Clock time of the last press, the one that completed the keys held */
+        long long completedAt = 0;
+        /* Incremented whenever the held keys change, hold timers of an older generation are stale */
+        uint32_t heldGeneration = 0;
+        /* Timers of hold keybinds and of taps waiting for the next tap */
+        TimerWheel timers;
+        /* Tables published so far, only the reloading thread publishes */
+        uint64_t publishCount = 0;
+        /* State of the hotstring automaton of the table with hotstringGeneration, and the states before the last characters for backspace */
+        uint64_t hotstringGeneration = 0;
+        uint32_t hotstringState = 0;
+        uint32_t hotstringHistory[MAX_HOTSTRING_LENGTH];
+        int hotstringPosition = 0;
+        int hotstringUndo = 0;
+        void typedKey(const table& active, int code);
+        /* Taps so far of the keys last tapped, when they have keybinds for several taps */
+        struct tapSequence
+        {
+            /* Sum of the keySignature of the keys, plus the layer */
+            uint64_t signature = 0;
+            uint64_t layer = 0;
+            uint16_t keys[MAX_CHORD_KEYS] = {};
+            uint8_t keyCount = 0;
+            /* 0 when nothing is waiting */
+            uint8_t count = 0;
+            uint32_t timer = NO_TIMER;
+        };
+        tapSequence tapping;
+        /* Hold time of the keybinds match() looks for, 0 outside of hold timers */
+        uint32_t matchingHold = 0;
+        /* Dual-role key held back until it is resolved, 0 when none is */
+        struct dualRole
+        {
+            uint16_t key = 0;
+            uint16_t tap = 0;
+            uint16_t hold = 0;
+            uint32_t timer = NO_TIMER;
+            long long pressedAt = 0;
+        };
+        dualRole dual;
+        /* Key sent for each key of the device that is down, 0 when it is sent as itself */
+        uint16_t sentAs[KEY_CNT] = {};
+        /* Remap of a chord, or to a chord, whose keys are down */
+        struct chordRemap
+        {
+            uint16_t keys[MAX_CHORD_KEYS];
+            uint16_t emit[MAX_CHORD_KEYS];
+            uint8_t keyCount = 0;
+            uint8_t emitCount = 0;
+        };
+        chordRemap remapped;
+        /* A keybind without passthrough fired for the current event */
+        bool consumed = false;
+        /* Keys whose press ran a keybind, their autorepeats and release are not passed on either */
+        bool suppressed[KEY_CNT] = {};
+        /* Active layers, bottom to top, the base layer is always below them */
+        uint64_t layerStack[MAX_LAYER_DEPTH] = {};
+        int layerDepth = 0;
+        int updateKeysHeld(int _key, int modifier);
+        bool isHeld(const action& candidate);
+        bool inTime(const action& candidate);
+        bool matchLayers(const table& active, int trigger);
+        bool match(const table& active, uint64_t layer, int trigger);
+        void fire(const table& active, uint32_t a);
+        void switchLayer(const table& active, const action& matched);
+        void runMacro(const table& active, const action& matched);
+        Macros macros;
+        Typist typist;
+        void scheduleHolds(const table& active);
+        void tapped(const table& active, bool tap);
+        void resolveTaps(const table& active);
+        void expired(const table& active, uint32_t kind, uint64_t data);
+        void matchEvent(const table& active, const struct input_event& ev);
+        void route(const table& active, const struct input_event& ev);
+        void resolveDual(bool hold);
+        uint32_t findRemap(const table& active, int code);
+        void beginRemap(const action& remap, int code);
+        void endRemap(int code);
+
+        /* skipped: keybinds with errors, only a file without any is stored in the binary cache */
+        bool parse(const string& path, const mappedFile& source, table& parsed, unsigned& skipped, vector<uint32_t>* lines = nullptr);
+        table* loadFile(const string& path, sourceSet& set, vector<uint32_t>* lines);
+        bool loadSources(const string& path, sourceSet& set, int depth);
+        bool loadDropIns(sourceSet& set);
+        string dropInDirectory();
+        table* merge(sourceSet& set, vector<pair<uint32_t, uint32_t>>* origins = nullptr);
+        table* compile(table* parsed);
+        table* patch(const table& old, table& parsed);
+        table* loadBinaryCache(const string& path, uint64_t sourceHash, size_t sourceSize);
+        void saveBinaryCache(const string& path, uint64_t sourceHash, size_t sourceSize, const table& compiled);
+        void buildIndex(table& compiled);
+        slot* findSlot(table& compiled, uint64_t signature);
+        uint32_t findAction(const table& compiled, const action& wanted);
+        void buildRemap(table& compiled);
+        void buildHotstrings(table& compiled);
+        void buildClassMasks(table& compiled);
+        void publish(table* compiled);
+        void watch();
+
+        Logger logger;
+
+        void printCache(const table& active);
+        string layerName(const table& active, uint64_t layer);
+
+        /* Offline analysis for --check */
+        string chordName(const table& parsed, const action& cached);
+        void checkSubsets(table& parsed, const vector<string>& where, unsigned& warnings);
+
+        friend class KeybindsParser;
+    public:
+        /* Nothing is loaded until the first reloadCache(), after file is set */
+        Keybinds() {};
+        ~Keybinds()
+        {
+            delete current.load();
+        };
+        /* Main config file, keybinds.d/ is next to it */
+        string file = "keybinds.json";
+
+        void updateDisk();
+        void reloadCache();
+        void checkKeybind(const struct input_event& ev);
+
+        /* Clock time the next timer or macro frame is due, -1 when none is pending, the owner calls runTimers() at that time */
+        long long nextTimer()
+        {
+            long long due = timers.next();
+            for(long long frame : { macros.next(), typist.next() })
+            {
+                due = due < 0 ? frame : frame < 0 ? due : min(due, frame);
+            }
+            return due;
+        }
+        /* Fire the hold and tap keybinds whose timers are due at the current clock time, play and type what is due */
+        void runTimers();
+
+        /* Reload the cache whenever the disk file changes, from a background thread */
+        void startWatcher();
+
+        /* Time source, set by the Listener before the first event */
+        Clock* clock = nullptr;
+
+        /* Characters of the keyboard, for hotstrings, typing and keys written as characters. Set before the first reloadCache() */
+        KeyboardLayout layout;
+
+        /* Print the decisions instead of executing the commands */
+        bool dryRun = false;
+        bool debug = false;
+        /* Grabbed device: events are passed on through the output device, set by the Listener */
+        OutputDevice* output = nullptr;
+        /* Virtual keyboard of the "emit" keybinds, set by the Listener */
+        OutputDevice* emitter = nullptr;
+        /* Runs the commands, the Listener reaps them when they exit */
+        Executor executor;
+        /* Only count the decisions, used by the stress bench and the allocation check */
+        bool stubActions = false;
+        unsigned long matchCount = 0;
+
+        /* Key lists of every cached keybind, used by the stress bench to generate chords */
+        vector<vector<int>> chords();
+
+        /* Report conflicts in keybinds.json without running, returns the exit status */
+        int check();
+};
+
+
+int Keybinds::updateKeysHeld(int _key, int modifier)
+{
+    /*
+        - Set should only contain keys that are currently held
+        - Returns 1 when a key was added or removed
+
+        1. Check if key is already held
+        YES: 2.1 Check if key is unheld --> modifier 0
+        NO: 2.2 Add the key, unless this is a release we never saw the press of
+    */
+    if(_key < 0 || _key >= KEY_CNT)
+    {
+        return 0;
+    }
+
+    int changed = 0;
+    if(!held[_key])
+    {
+        if(modifier != 0) /* Prevent buggy situations where the 0 modifier is the only key in the set */
+        {
+            held[_key] = true;
+            pressedAt[_key] = clock->now();
+            pressedSequence[_key] = ++pressCount;
+            completedAt = pressedAt[_key];
+            heldCount++;
+            heldSignature += keySignature(_key);
+            heldGeneration++;
+            changed = 1;
+        }
+    }
+    else if(modifier == 0)
+    {
+        held[_key] = false;
+        heldCount--;
+        heldSignature -= keySignature(_key);
+        heldGeneration++;
+        changed = 1;
+    }
+    if(changed && keyClass(_key) >= 0)
+    {
+        updateClass(keyClass(_key));
+        typist.modifiersHeld(heldClasses != 0, clock->now());
+    }
+
+    if(logger.showKeysHeld)
+    {
+        cout << endl << "--------------------" << endl;
+        for(int code = 0; code < KEY_CNT; code++)
+        {
+            if(held[code])
+            {
+                cout << "KEY: " << code << " PRESSED AT: " << pressedAt[code] << " - ";
+            }
+        }
+        cout << endl << "--------------------" << endl;
+    }
+    
+    return changed;
+};
+
+
+void Keybinds::printCache(const table& active)
+{
+    if(active.cache.size() > PRINT_CACHE_LIMIT)
+    {
+        cout << "Current keybindings: " << active.cache.size() << " (too many to list)" << endl;
+        return;
+    }
+    cout << "Current keybindings: " << endl;
+    cout << "--------------------" << endl;
+
+    for(size_t a = 0; a < active.cache.size(); a++)
+    {
+        const action& cached = active.cache[a];
+        if(cached.removed)
+        {
+            continue;
+        }
+        cout << "Action: " << active.command(cached) << " (fired " << active.states[a]->fired << " times, " << active.states[a]->running << " running)" << endl;
+        if(cached.layer != 0)
+        {
+            cout << "Layer: " << layerName(active, cached.layer) << endl;
+        }
+        if(cached.trigger != TRIGGER_PRESS)
+        {
+            cout << "Trigger: " << triggerNames[cached.trigger] << endl;
+        }
+        if(cached.layerOp != LAYER_NONE)
+        {
+            static const char* names[] = { "", "Push", "Pop", "Toggle" };
+            cout << names[cached.layerOp] << " layer: " << (cached.target ? layerName(active, cached.target) : "top") << endl;
+        }
+        if(cached.macroOp != MACRO_NONE)
+        {
+            static const char* names[] = { "", "Record macro: ", "Play macro: ", "Type: ", "Type file: " };
+            cout << names[cached.macroOp];
+            cout.write(active.text(cached), cached.textLength);
+            cout << (cached.speed != 100 ? " (speed " + to_string(cached.speed) + "%)" : "") << endl;
+        }
+        if(cached.output != OUTPUT_NONE)
+        {
+            static const char* names[] = { "", "Dual-role (tap, hold)", "Remap", "Emit" };
+            cout << names[cached.output] << ":";
+            for(int k = 0; k < cached.emitCount; k++)
+            {
+                const char* name = keyCodeName(cached.emit[k]);
+                cout << " " << (name ? string(name) : to_string(cached.emit[k]));
+            }
+            cout << endl;
+        }
+        if(cached.hotstringLength)
+        {
+            cout << "Hotstring: ";
+            cout.write(active.hotstring(cached), cached.hotstringLength) << endl;
+        }
+        cout << "Keybind: " << endl;
+        for(int k = 0; k < cached.keyCount; k++)
+        {
+            const char* name = keyCodeName(cached.keys[k]);
+            cout << "KEY: " << cached.keys[k] << (name ? " (" + string(name) + ")" : "") << " - ";
+        }
+        cout << endl << "--------------------" << endl;
+    }
+};
+
+
+void Keybinds::runMacro(const table& active, const action& matched)
+{
+    const char* text = active.text(matched);
+    if(matched.macroOp == MACRO_RECORD && macros.recording())
+    {
+        macros.stopRecording(matched.keys, matched.keyCount);
+        debug && logger.log("Stopped recording the macro");
+    }
+    else if(matched.macroOp == MACRO_RECORD)
+    {
+        macros.startRecording(contentHash(text, matched.textLength));
+        debug && logger.log("Recording macro " + string(text, matched.textLength));
+    }
+    else if(!emitter)
+    {
+        return;
+    }
+    else if(matched.macroOp == MACRO_PLAY && !macros.play(contentHash(text, matched.textLength), matched.speed, clock->now(), *emitter))
+    {
+        logger.log("Macro " + string(text, matched.textLength) + " was not recorded");
+    }
+    else if(matched.macroOp == MACRO_TYPE)
+    {
+        /* A hotstring is replaced by the text, its last character never arrived when the keybind holds its key back */
+        int erase = matched.hotstringLength ? matched.hotstringLength - (output && !matched.passthrough) : 0;
+        typist.type(text, matched.textLength, clock->now(), *emitter, layout, erase);
+    }
+    else if(matched.macroOp == MACRO_TYPE_FILE)
+    {
+        ifstream file(string(text, matched.textLength), ios::binary);
+        string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if(!file.is_open() || file.bad())
+        {
+            logger.error("Failed to read " + string(text, matched.textLength) + " to type it");
+            return;
+        }
+        typist.type(contents.data(), contents.size(), clock->now(), *emitter, layout);
+    }
+}
+
+
+string Keybinds::layerName(const table& active, uint64_t layer)
+{
+    /* Only for output, the names are not kept by signature */
+    size_t start = 0;
+    for(size_t end; layer != 0 && (end = active.layers.find('\n', start)) != string::npos; start = end + 1)
+    {
+        if(layerSignature(active.layers.data() + start, end - start) == layer)
+        {
+            return active.layers.substr(start, end - start);
+        }
+    }
+    return layer == 0 ? "base" : "?";
+}
+
+
+vector<vector<int>> Keybinds::chords()
+{
+    vector<vector<int>> result;
+    for(const auto& cached : current.load()->cache)
+    {
+        if(cached.removed || cached.keyCount == 0)
+        {
+            continue;
+        }
+        /* A device sends the left key of a modifier class */
+        vector<int> keys(cached.keys, cached.keys + cached.keyCount);
+        for(int& key : keys)
+        {
+            key = key >= KEY_CLASS_FIRST ? classKeys[key - KEY_CLASS_FIRST][0] : key;
+        }
+        result.push_back(keys);
+    }
+    return result;
+}
+
+
+void Keybinds::updateClass(int c)
+{
+    /* Once per press or release of a modifier, the lookups only add classDelta */
+    uint16_t left = classKeys[c][0];
+    uint16_t right = classKeys[c][1];
+    int code = KEY_CLASS_FIRST + c;
+    uint16_t first = held[left] && (!held[right] || pressedSequence[left] < pressedSequence[right]) ? left : right;
+    classHeld[c] = held[left] + held[right];
+    held[code] = classHeld[c] > 0;
+    pressedAt[code] = pressedAt[first];
+    pressedSequence[code] = pressedSequence[first];
+    heldClasses = held[code] ? heldClasses | 1u << c : heldClasses & ~(1u << c);
+
+    uint64_t offsets[KEY_CLASS_COUNT];
+    for(int k = 0; k < KEY_CLASS_COUNT; k++)
+    {
+        offsets[k] = !held[KEY_CLASS_FIRST + k] ? 0 : keySignature(KEY_CLASS_FIRST + k)
+            - (held[classKeys[k][0]] ? keySignature(classKeys[k][0]) : 0) - (held[classKeys[k][1]] ? keySignature(classKeys[k][1]) : 0);
+    }
+    for(unsigned mask = 1; mask < 1u << KEY_CLASS_COUNT; mask++)
+    {
+        /* Every mask is a smaller mask plus its lowest class */
+        classDelta[mask] = classDelta[mask & (mask - 1)] + offsets[__builtin_ctz(mask)];
+    }
+}
+
+
+bool Keybinds::isHeld(const action& candidate)
+{
+    /* Signatures can collide, compare the actual keys, a class stands for the keys of it that are held */
+    int count = heldCount;
+    for(int k = 0; k < candidate.keyCount; k++)
+    {
+        if(!held[candidate.keys[k]])
+        {
+            return false;
+        }
+        count -= candidate.keys[k] >= KEY_CLASS_FIRST ? classHeld[candidate.keys[k] - KEY_CLASS_FIRST] - 1 : 0;
+    }
+    return candidate.keyCount == count;
+}
+
+
+bool Keybinds::inTime(const action& candidate)
+{
+    /* "ordered" and "window" keybinds, the keys are known to be held */
+    for(int k = 1; candidate.ordered && k < candidate.keyCount; k++)
+    {
+        if(pressedSequence[candidate.keys[candidate.order[k]]] < pressedSequence[candidate.keys[candidate.order[k - 1]]])
+        {
+            return false;
+        }
+    }
+    if(candidate.window == 0)
+    {
+        return true;
+    }
+    long long first = pressedAt[candidate.keys[0]];
+    long long last = first;
+    for(int k = 1; k < candidate.keyCount; k++)
+    {
+        first = min(first, pressedAt[candidate.keys[k]]);
+        last = max(last, pressedAt[candidate.keys[k]]);
+    }
+    return last - first <= candidate.window;
+}
+
+
+void Keybinds::fire(const table& active, uint32_t a)
+{
+    matchCount++;
+    active.states[a]->fired.fetch_add(1, memory_order_relaxed);
+    const action& matched = active.cache[a];
+    consumed |= !matched.passthrough;
+    if(matched.layerOp != LAYER_NONE)
+    {
+        switchLayer(active, matched);
+    }
+    if(stubActions)
+    {
+        return;
+    }
+    if(matched.output == OUTPUT_EMIT && emitter)
+    {
+        emitter->tap(matched.emit, matched.emitCount);
+    }
+    if(matched.macroOp != MACRO_NONE)
+    {
+        runMacro(active, matched);
+    }
+    if(matched.commandLength == 0)
+    {
+        return;
+    }
+    if(dryRun)
+    {
+        /* Only clock time and command, so two replays of the same recording can be diffed */
+        cout << "[>] " << clock->now() << " ";
+        cout.write(active.strings.data() + matched.commandOffset, matched.commandLength) << endl;
+        return;
+    }
+    executor.run(active.command(matched), active.states[a]);
+}
+
+
+void Keybinds::typedKey(const table& active, int code)
+{
+    /*
+        - Hotstrings: the character of every key press is one transition of the automaton, whatever the number of hotstrings
+        - Backspace goes back a character, any other key that types no character (arrows, shortcuts) starts over
+        - Shift and AltGr are read from the held keys, capslock is not known and counts as off
+    */
+    if(active.hotstringColumns == 0)
+    {
+        return;
+    }
+    if(hotstringGeneration != active.generation)
+    {
+        /* States of another automaton */
+        hotstringGeneration = active.generation;
+        hotstringState = 0;
+        hotstringUndo = 0;
+    }
+    int level = (held[KEY_LEFTSHIFT] || held[KEY_RIGHTSHIFT] ? LAYOUT_SHIFT : 0) | (held[KEY_RIGHTALT] ? LAYOUT_ALTGR : 0);
+    if(code == KEY_LEFTSHIFT || code == KEY_RIGHTSHIFT || code == KEY_RIGHTALT)
+    {
+        return;
+    }
+    if(code == KEY_BACKSPACE)
+    {
+        hotstringPosition = hotstringUndo ? (hotstringPosition + MAX_HOTSTRING_LENGTH - 1) % MAX_HOTSTRING_LENGTH : hotstringPosition;
+        hotstringState = hotstringUndo ? hotstringHistory[hotstringPosition] : 0;
+        hotstringUndo -= hotstringUndo > 0;
+        return;
+    }
+    bool shortcut = held[KEY_LEFTCTRL] || held[KEY_RIGHTCTRL] || held[KEY_LEFTALT] || held[KEY_LEFTMETA] || held[KEY_RIGHTMETA];
+    uint32_t c = layout.character(code, level);
+    if(c == 0 || c >= 128 || shortcut)
+    {
+        hotstringState = 0;
+        hotstringUndo = 0;
+        return;
+    }
+    hotstringHistory[hotstringPosition] = hotstringState;
+    hotstringPosition = (hotstringPosition + 1) % MAX_HOTSTRING_LENGTH;
+    hotstringUndo = min(hotstringUndo + 1, MAX_HOTSTRING_LENGTH);
+    hotstringState = active.hotstringNext[hotstringState * active.hotstringColumns + active.hotstringClass[c]];
+    uint32_t typed = active.hotstringAccept[hotstringState];
+    if(typed != NO_ACTION)
+    {
+        hotstringState = 0;
+        hotstringUndo = 0;
+        fire(active, typed);
+    }
+}
+
+
+void Keybinds::checkKeybind(const struct input_event& ev)
+{
+    epoch.fetch_add(1); // Odd: a reload has to wait before freeing the table we are about to read
+    const table& active = *current.load();
+    consumed = false;
+    if(ev.code < KEY_CNT)
+    {
+        /* Before matching, the press of a record keybind is not part of the macro it starts */
+        macros.record(ev);
+        matchEvent(active, ev);
+    }
+    if(output)
+    {
+        route(active, ev);
+    }
+    epoch.fetch_add(1);
+}
+
+
+void Keybinds::matchEvent(const table& active, const struct input_event& ev)
+{
+    /* Release and tap keybinds match the keys held up to the release, so look them up before updating */
+    bool release = ev.value == 0;
+    bool tap = release && tapArmed;
+    tapArmed = !release && (tapArmed || ev.value == 1);
+    int changed = release ? 0 : updateKeysHeld(ev.code, ev.value);
+    if(release ? !held[ev.code] : !changed && ev.value == 1)
+    {
+        /* Release of a key that was not held, or press of a key that already was */
+        return;
+    }
+
+    if(release)
+    {
+        tapped(active, tap);
+        matchLayers(active, TRIGGER_RELEASE);
+        if(tap)
+        {
+            matchLayers(active, TRIGGER_TAP);
+        }
+    }
+    else
+    {
+        if(changed && ev.value == 1)
+        {
+            /* Another key ends the taps waiting for the next one, the same keys wait for their release */
+            int c = keyClass(ev.code);
+            bool same = tapping.count && (find(tapping.keys, tapping.keys + tapping.keyCount, ev.code) != tapping.keys + tapping.keyCount
+                || (c >= 0 && find(tapping.keys, tapping.keys + tapping.keyCount, KEY_CLASS_FIRST + c) != tapping.keys + tapping.keyCount));
+            if(same)
+            {
+                timers.cancel(tapping.timer);
+                tapping.timer = timers.schedule(clock->now() + TAP_TERM_US, TIMER_TAPS, 0);
+            }
+            else
+            {
+                /* The taps belong to another key, firing them doesn't consume this press */
+                bool wasConsumed = consumed;
+                resolveTaps(active);
+                consumed = wasConsumed;
+            }
+            scheduleHolds(active);
+            typedKey(active, ev.code);
+        }
+        matchLayers(active, ev.value == 1 ? TRIGGER_PRESS : TRIGGER_REPEAT);
+    }
+
+    if(release)
+    {
+        updateKeysHeld(ev.code, ev.value);
+    }
+};
+
+
+bool Keybinds::matchLayers(const table& active, int trigger)
+{
+    /* Top layer first, the first layer with a match wins */
+    bool matched = false;
+    for(int d = layerDepth; d-- > 0 && !matched;)
+    {
+        matched = match(active, layerStack[d], trigger);
+    }
+    return matched || match(active, 0, trigger);
+}
+
+
+bool Keybinds::match(const table& active, uint64_t layer, int trigger)
+{
+    const vector<slot>& index = active.index;
+    const vector<action>& cache = active.cache;
+
+    /* The keys as they are first, then with modifiers as classes, the first set of keys with a match wins */
+    bool matched = false;
+    for(unsigned mask = 0; mask < 1u << KEY_CLASS_COUNT && !matched; mask++)
+    {
+        if(!classMask(active, mask))
+        {
+            continue;
+        }
+        uint64_t signature = heldSignature + classDelta[mask] + layer + triggerSignature(trigger);
+
+        /* Linear probing until the signature or an empty slot is found */
+        for(uint64_t i = signature & active.indexMask; index[i].first != NO_ACTION; i = (i + 1) & active.indexMask)
+        {
+            if(index[i].signature != signature)
+            {
+                continue;
+            }
+            /* Keybinds for a number of taps are fired by resolveTaps() when the taps are counted, match() only fires every tap */
+            for(uint32_t a = index[i].first; a < REMOVED_ACTIONS; a = cache[a].next)
+            {
+                if(cache[a].layer == layer && cache[a].trigger == trigger && cache[a].hold == matchingHold && cache[a].taps == 0
+                    && isHeld(cache[a]) && inTime(cache[a]))
+                {
+                    fire(active, a);
+                    matched = true;
+                }
+            }
+            break;
+        }
+    }
+    return matched;
+}
+
+
+void Keybinds::switchLayer(const table& active, const action& matched)
+{
+    int found = -1;
+    for(int d = layerDepth; d-- > 0 && found < 0;)
+    {
+        found = layerStack[d] == matched.target ? d : -1;
+    }
+    if(matched.layerOp == LAYER_POP && matched.target == 0)
+    {
+        found = layerDepth - 1;
+    }
+
+    /* Remove the layer, a push moves an active layer to the top */
+    uint64_t switched = found >= 0 ? layerStack[found] : matched.target;
+    if(found >= 0)
+    {
+        memmove(layerStack + found, layerStack + found + 1, (layerDepth - found - 1) * sizeof(layerStack[0]));
+        layerDepth--;
+    }
+    bool push = matched.layerOp == LAYER_PUSH || (matched.layerOp == LAYER_TOGGLE && found < 0);
+    if(push && layerDepth < MAX_LAYER_DEPTH)
+    {
+        layerStack[layerDepth++] = matched.target;
+    }
+
+    if(dryRun)
+    {
+        static const char* names[] = { "", "push", "pop", "toggle" };
+        cout << "[>] " << clock->now() << " " << names[matched.layerOp] << " " << layerName(active, switched) << endl;
+    }
+}
+
+
+void Keybinds::scheduleHolds(const table& active)
+{
+    /* The keys were just completed: one timer per hold time of the first layer with hold keybinds for them */
+    const vector<action>& cache = active.cache;
+    auto holds = [&](uint32_t a, uint64_t layer) {
+        return cache[a].layer == layer && cache[a].trigger == TRIGGER_HOLD && isHeld(cache[a]) && inTime(cache[a]);
+    };
+    long long now = clock->now();
+    bool scheduled = false;
+    for(int d = layerDepth; d >= 0 && !scheduled; d--)
+    {
+        uint64_t layer = d > 0 ? layerStack[d - 1] : 0;
+        for(unsigned mask = 0; mask < 1u << KEY_CLASS_COUNT && !scheduled; mask++)
+        {
+            uint64_t signature = heldSignature + classDelta[mask] + layer + triggerSignature(TRIGGER_HOLD);
+            slot* found = classMask(active, mask) ? findSlot(const_cast<table&>(active), signature) : nullptr;
+            for(uint32_t a = found ? found->first : NO_ACTION; a < REMOVED_ACTIONS; a = cache[a].next)
+            {
+                if(!holds(a, layer))
+                {
+                    continue;
+                }
+                /* Keybinds with the same hold time share the timer */
+                uint32_t b = found->first;
+                while(b != a && !(holds(b, layer) && cache[b].hold == cache[a].hold))
+                {
+                    b = cache[b].next;
+                }
+                if(b == a)
+                {
+                    timers.schedule(now + cache[a].hold, TIMER_HOLD, (uint64_t)heldGeneration << 32 | cache[a].hold);
+                }
+                scheduled = true;
+            }
+        }
+    }
+}
+
+
+void Keybinds::tapped(const table& active, bool tap)
+{
+    /*
+        Release of the held keys, before they are updated
+        - A tap of keys with keybinds for several taps counts towards them, other keys resolve the taps so far
+        - Presses longer than TAP_TERM_US are not taps for these keybinds
+    */
+    const vector<action>& cache = active.cache;
+    uint64_t layer = 0;
+    uint64_t signature = 0;
+    int most = 0;
+    const action* keys = nullptr;
+    for(int d = layerDepth; d >= 0 && tap && most == 0 && clock->now() - completedAt <= TAP_TERM_US; d--)
+    {
+        layer = d > 0 ? layerStack[d - 1] : 0;
+        for(unsigned mask = 0; mask < 1u << KEY_CLASS_COUNT && most == 0; mask++)
+        {
+            signature = heldSignature + classDelta[mask] + layer;
+            slot* found = classMask(active, mask) ? findSlot(const_cast<table&>(active), signature + triggerSignature(TRIGGER_TAP)) : nullptr;
+            for(uint32_t a = found ? found->first : NO_ACTION; a < REMOVED_ACTIONS; a = cache[a].next)
+            {
+                if(cache[a].layer == layer && cache[a].trigger == TRIGGER_TAP && cache[a].taps > most && isHeld(cache[a]) && inTime(cache[a]))
+                {
+                    most = cache[a].taps;
+                    keys = &cache[a];
+                }
+            }
+        }
+    }
+    if(tapping.count && (most == 0 || tapping.signature != signature || tapping.layer != layer))
+    {
+        resolveTaps(active);
+    }
+    if(most == 0)
+    {
+        return;
+    }
+
+    timers.cancel(tapping.timer);
+    tapping.timer = NO_TIMER;
+    if(tapping.count == 0)
+    {
+        tapping.signature = signature;
+        tapping.layer = layer;
+        tapping.keyCount = keys->keyCount;
+        copy(keys->keys, keys->keys + keys->keyCount, tapping.keys);
+    }
+    if(++tapping.count >= most)
+    {
+        /* Nothing more to wait for */
+        resolveTaps(active);
+        return;
+    }
+    tapping.timer = timers.schedule(clock->now() + TAP_TERM_US, TIMER_TAPS, 0);
+}
+
+
+void Keybinds::resolveTaps(const table& active)
+{
+    /* Fire the keybinds for the number of taps so far, the keys are not held anymore */
+    if(tapping.count == 0)
+    {
+        return;
+    }
+    timers.cancel(tapping.timer);
+    tapping.timer = NO_TIMER;
+    const vector<action>& cache = active.cache;
+    slot* found = findSlot(const_cast<table&>(active), tapping.signature + triggerSignature(TRIGGER_TAP));
+    for(uint32_t a = found ? found->first : NO_ACTION; a < REMOVED_ACTIONS; a = cache[a].next)
+    {
+        if(cache[a].layer == tapping.layer && cache[a].trigger == TRIGGER_TAP && cache[a].taps == tapping.count
+            && cache[a].keyCount == tapping.keyCount && equal(tapping.keys, tapping.keys + tapping.keyCount, cache[a].keys))
+        {
+            fire(active, a);
+        }
+    }
+    tapping.count = 0;
+}
+
+
+void Keybinds::expired(const table& active, uint32_t kind, uint64_t data)
+{
+    if(kind == TIMER_TAPS)
+    {
+        tapping.timer = NO_TIMER;
+        resolveTaps(active);
+        return;
+    }
+    if(kind == TIMER_DUAL)
+    {
+        dual.timer = NO_TIMER;
+        resolveDual(true);
+        return;
+    }
+    /* TIMER_HOLD: generation and hold time, stale once the held keys changed */
+    if((uint32_t)(data >> 32) != heldGeneration)
+    {
+        return;
+    }
+    resolveTaps(active);
+    matchingHold = (uint32_t)data;
+    if(matchLayers(active, TRIGGER_HOLD))
+    {
+        /* The release after a hold is not a tap */
+        tapArmed = false;
+    }
+    matchingHold = 0;
+}
+
+
+void Keybinds::runTimers()
+{
+    epoch.fetch_add(1);
+    const table& active = *current.load();
+    timers.advance(clock->now(), [this, &active](uint32_t kind, uint64_t data) {
+        expired(active, kind, data);
+    });
+    epoch.fetch_add(1);
+    macros.advance(clock->now());
+    typist.advance(clock->now());
+    if(output)
+    {
+        /* Keys sent by timers are not part of a frame of the device */
+        output->flush();
+    }
+}
+
+
+void Keybinds::route(const table& active, const struct input_event& ev)
+{
+    /* Grabbed device: pass the event on, unless it ran a keybind or belongs to a dual-role key */
+    if(ev.code >= KEY_CNT)
+    {
+        output->push(ev);
+        return;
+    }
+    int code = ev.code;
+    if(suppressed[code])
+    {
+        suppressed[code] = ev.value != 0;
+        return;
+    }
+    if(remapped.keyCount && ev.value != 1 && find(remapped.keys, remapped.keys + remapped.keyCount, code) != remapped.keys + remapped.keyCount)
+    {
+        /* Autorepeats repeat the last key sent, the first release ends the remap */
+        if(ev.value == 2)
+        {
+            output->emit(remapped.emit[remapped.emitCount - 1], 2);
+        }
+        else
+        {
+            endRemap(code);
+        }
+        return;
+    }
+    if(dual.key && code == dual.key)
+    {
+        /* Released before it was resolved: a tap. Autorepeats are dropped */
+        if(ev.value == 0)
+        {
+            resolveDual(false);
+        }
+        return;
+    }
+    if(ev.value == 1 && dual.key)
+    {
+        /* Another key is pressed while the dual-role key is down: a hold, sent before that key */
+        resolveDual(true);
+    }
+    if(consumed && ev.value != 0)
+    {
+        /* The press (or autorepeat) ran a keybind, a press takes the rest of the key with it */
+        suppressed[code] = ev.value == 1;
+        return;
+    }
+    uint32_t remap = ev.value == 1 && active.indexedRemaps ? findRemap(active, code) : NO_ACTION;
+    if(remap != NO_ACTION && (active.cache[remap].keyCount > 1 || active.cache[remap].emitCount > 1))
+    {
+        beginRemap(active.cache[remap], code);
+        return;
+    }
+    if(ev.value == 1)
+    {
+        const vector<action>& cache = active.cache;
+        for(int d = layerDepth; d >= 0 && !dual.key; d--)
+        {
+            uint64_t layer = d > 0 ? layerStack[d - 1] : 0;
+            slot* found = findSlot(const_cast<table&>(active), keySignature(code) + layer + outputSignature(OUTPUT_DUAL));
+            for(uint32_t a = found ? found->first : NO_ACTION; a < REMOVED_ACTIONS && !dual.key; a = cache[a].next)
+            {
+                if(cache[a].layer == layer && cache[a].output == OUTPUT_DUAL && cache[a].keyCount == 1 && cache[a].keys[0] == code)
+                {
+                    dual.key = code;
+                    dual.tap = cache[a].emit[0];
+                    dual.hold = cache[a].emit[1];
+                    dual.pressedAt = clock->now();
+                    dual.timer = timers.schedule(dual.pressedAt + DUAL_ROLE_TIMEOUT_US, TIMER_DUAL, 0);
+                }
+            }
+        }
+        if(dual.key)
+        {
+            return;
+        }
+        /* Remapped to one other key: the flat translation, unless a layer remaps it */
+        sentAs[code] = remap != NO_ACTION ? active.cache[remap].emit[0] : active.remap[code];
+        sentAs[code] = sentAs[code] == code ? 0 : sentAs[code];
+    }
+    output->emit(sentAs[code] ? sentAs[code] : code, ev.value);
+    if(ev.value == 0)
+    {
+        sentAs[code] = 0;
+    }
+}
+
+
+uint32_t Keybinds::findRemap(const table& active, int code)
+{
+    /* Top layer first, in each layer a remap of the keys held before a remap of the key alone */
+    const vector<action>& cache = active.cache;
+    for(int d = layerDepth; d >= 0; d--)
+    {
+        uint64_t layer = d > 0 ? layerStack[d - 1] : 0;
+        for(int single = 0; single < 2; single++)
+        {
+            slot* found = findSlot(const_cast<table&>(active), (single ? keySignature(code) : heldSignature) + layer + outputSignature(OUTPUT_REMAP));
+            for(uint32_t a = found ? found->first : NO_ACTION; a < REMOVED_ACTIONS; a = cache[a].next)
+            {
+                bool keys = single ? cache[a].keyCount == 1 && cache[a].keys[0] == code : cache[a].keyCount > 1 && isHeld(cache[a]);
+                if(cache[a].layer == layer && cache[a].output == OUTPUT_REMAP && keys)
+                {
+                    return a;
+                }
+            }
+        }
+    }
+    return NO_ACTION;
+}
+
+
+void Keybinds::beginRemap(const action& remap, int code)
+{
+    /* The other keys of the chord were passed on already, they are released before the keys of the remap are pressed */
+    if(remapped.keyCount)
+    {
+        endRemap(0);
+    }
+    for(int k = 0; k < remap.keyCount; k++)
+    {
+        int key = remap.keys[k];
+        if(key != code && !suppressed[key])
+        {
+            output->emit(sentAs[key] ? sentAs[key] : key, 0);
+        }
+    }
+    for(int k = 0; k < remap.emitCount; k++)
+    {
+        output->emit(remap.emit[k], 1);
+    }
+    remapped.keyCount = remap.keyCount;
+    remapped.emitCount = remap.emitCount;
+    copy(remap.keys, remap.keys + remap.keyCount, remapped.keys);
+    copy(remap.emit, remap.emit + remap.emitCount, remapped.emit);
+}
+
+
+void Keybinds::endRemap(int code)
+{
+    /* Release in reverse order, the keys of the chord that are still down are pressed again */
+    for(int k = remapped.emitCount; k-- > 0;)
+    {
+        output->emit(remapped.emit[k], 0);
+    }
+    for(int k = 0; k < remapped.keyCount; k++)
+    {
+        int key = remapped.keys[k];
+        if(key != code && held[key] && !suppressed[key])
+        {
+            output->emit(sentAs[key] ? sentAs[key] : key, 1);
+        }
+    }
+    remapped.keyCount = 0;
+}
+
+
+void Keybinds::resolveDual(bool hold)
+{
+    timers.cancel(dual.timer);
+    dual.timer = NO_TIMER;
+    if(hold)
+    {
+        /* Sent as the hold key until the release of the dual-role key */
+        output->emit(dual.hold, 1);
+        sentAs[dual.key] = dual.hold;
+    }
+    else
+    {
+        output->emit(dual.tap, 1);
+        output->emit(dual.tap, 0);
+    }
+    debug && logger.log("Dual-role key " + to_string(dual.key) + " resolved as " + (hold ? "hold" : "tap") + " after "
+        + to_string(clock->now() - dual.pressedAt) + " us");
+    dual.key = 0;
+}
+
+
+void Keybinds::buildIndex(table& compiled)
+{
+    vector<action>& cache = compiled.cache;
+    vector<slot>& index = compiled.index;
+
+    /* Power of two capacity, at most half full */
+    size_t capacity = 16;
+    while(capacity < cache.size() * 2)
+    {
+        capacity *= 2;
+    }
+    index.assign(capacity, slot{0, NO_ACTION, 0});
+    compiled.indexMask = capacity - 1;
+
+    /* Walk backwards so every chain ends up in file order */
+    for(size_t a = cache.size(); a-- > 0;)
+    {
+        if(cache[a].removed)
+        {
+            continue;
+        }
+        uint64_t i = cache[a].signature & compiled.indexMask;
+        while(index[i].first != NO_ACTION && index[i].signature != cache[a].signature)
+        {
+            i = (i + 1) & compiled.indexMask;
+        }
+        cache[a].next = index[i].first;
+        index[i].signature = cache[a].signature;
+        index[i].first = a;
+    }
+}
+
+
+void Keybinds::buildRemap(table& compiled)
+{
+    compiled.remap.assign(KEY_CNT, 0);
+    compiled.indexedRemaps = false;
+    for(const auto& cached : compiled.cache)
+    {
+        if(cached.removed || cached.output != OUTPUT_REMAP)
+        {
+            continue;
+        }
+        bool flat = cached.layer == 0 && cached.keyCount == 1 && cached.emitCount == 1;
+        if(flat && compiled.remap[cached.keys[0]] == 0)
+        {
+            compiled.remap[cached.keys[0]] = cached.emit[0];
+        }
+        compiled.indexedRemaps |= !flat;
+    }
+}
+
+
+void Keybinds::buildHotstrings(table& compiled)
+{
+    /*
+        - A trie of the hotstrings over the character classes, then the failure links breadth first:
+          a missing transition takes the one of the failure state, and a state accepts what its failure state accepts
+          unless it completes a hotstring of its own
+        - NO_ACTION marks a missing transition while building
+    */
+    vector<uint32_t>& next = compiled.hotstringNext;
+    vector<uint32_t>& accept = compiled.hotstringAccept;
+    uint32_t& columns = compiled.hotstringColumns;
+    next.clear();
+    accept.clear();
+    fill(compiled.hotstringClass, compiled.hotstringClass + 128, 0);
+    columns = 0;
+    for(const auto& cached : compiled.cache)
+    {
+        const char* hotstring = compiled.hotstring(cached);
+        for(int c = 0; !cached.removed && c < cached.hotstringLength; c++)
+        {
+            uint8_t& characterClass = compiled.hotstringClass[(int)hotstring[c]];
+            characterClass = characterClass ? characterClass : ++columns;
+        }
+    }
+    if(columns == 0)
+    {
+        return;
+    }
+    columns++;
+    next.assign(columns, NO_ACTION);
+    accept.assign(1, NO_ACTION);
+    for(uint32_t a = 0; a < compiled.cache.size(); a++)
+    {
+        const action& cached = compiled.cache[a];
+        if(cached.removed || cached.hotstringLength == 0)
+        {
+            continue;
+        }
+        const char* hotstring = compiled.hotstring(cached);
+        uint32_t state = 0;
+        for(int c = 0; c < cached.hotstringLength; c++)
+        {
+            size_t edge = state * columns + compiled.hotstringClass[(int)hotstring[c]];
+            if(next[edge] == NO_ACTION)
+            {
+                next[edge] = accept.size();
+                accept.push_back(NO_ACTION);
+                next.resize(next.size() + columns, NO_ACTION);
+            }
+            state = next[edge];
+        }
+        accept[state] = accept[state] == NO_ACTION ? a : accept[state];
+    }
+
+    vector<uint32_t> fail(accept.size(), 0);
+    vector<uint32_t> queue;
+    for(uint32_t c = 0; c < columns; c++)
+    {
+        if(next[c] == NO_ACTION)
+        {
+            next[c] = 0;
+        }
+        else
+        {
+            queue.push_back(next[c]);
+        }
+    }
+    for(size_t q = 0; q < queue.size(); q++)
+    {
+        uint32_t state = queue[q];
+        accept[state] = accept[state] == NO_ACTION ? accept[fail[state]] : accept[state];
+        for(uint32_t c = 0; c < columns; c++)
+        {
+            uint32_t& to = next[state * columns + c];
+            uint32_t fallback = next[fail[state] * columns + c];
+            if(to == NO_ACTION)
+            {
+                to = fallback;
+            }
+            else
+            {
+                fail[to] = fallback;
+                queue.push_back(to);
+            }
+        }
+    }
+}
+
+void Keybinds::buildClassMasks(table& compiled)
+{
+    compiled.classMasks = 1;
+    for(const auto& cached : compiled.cache)
+    {
+        unsigned mask = 0;
+        for(int k = 0; !cached.removed && k < cached.keyCount; k++)
+        {
+            mask |= cached.keys[k] >= KEY_CLASS_FIRST ? 1u << (cached.keys[k] - KEY_CLASS_FIRST) : 0;
+        }
+        compiled.classMasks |= 1u << mask;
+    }
+}
+
+void Keybinds::publish(table* compiled)
+{
+    buildRemap(*compiled);
+    buildHotstrings(*compiled);
+    buildClassMasks(*compiled);
+    compiled->generation = ++publishCount;
+    table* old = current.exchange(compiled);
+    if(!old)
+    {
+        return;
+    }
+
+    /*
+        Grace period
+        - A listener that entered checkKeybind before the swap may still be reading old
+        - Any lookup that starts after the swap reads the new table
+        --> If the epoch is odd, wait until it moves, after that nobody can hold old anymore
+    */
+    unsigned long seen = epoch.load();
+    while(seen % 2 == 1 && epoch.load() == seen)
+    {
+        usleep(100);
+    }
+    delete old;
+}
+
+
+void Keybinds::reloadCache()
+{
+    /* Only one thread reloads at a time (startup, then the watcher), so reading current here is safe */
+    table* old = current.load();
+
+    sourceSet set;
+    table* parsed = nullptr;
+    if(loadSources(file, set, 0) && loadDropIns(set))
+    {
+        parsed = merge(set);
+        sources = set.paths;
+    }
+    else
+    {
+        for(table* part : set.parts)
+        {
+            delete part;
+        }
+    }
+
+    if(!parsed)
+    {
+        if(!old)
+        {
+            /* Nothing loaded yet, start with an empty table so the listener always has one */
+            table* empty = new table();
+            buildIndex(*empty);
+            publish(empty);
+        }
+        return;
+    }
+
+    table* compiled = old ? patch(*old, *parsed) : compile(parsed);
+    if(old)
+    {
+        delete parsed;
+    }
+    if(!compiled)
+    {
+        logger.log("Keybinds unchanged, cache kept");
+        return;
+    }
+    publish(compiled);
+    logger.log("Cache has been reloaded");
+    printCache(*compiled);
+}
+
+
+Keybinds::table* Keybinds::loadFile(const string& path, sourceSet& set, vector<uint32_t>* lines)
+{
+    mappedFile source;
+    if(!source.open(path.c_str()))
+    {
+        logger.error("Unable to open file: " + path);
+        return nullptr;
+    }
+    /* Keys written as characters are resolved through the layout */
+    uint64_t sourceHash = bulkHash(source.data, source.size) ^ layout.hash;
+    table* parsed = set.check ? nullptr : loadBinaryCache(path, sourceHash, source.size);
+    if(parsed)
+    {
+        return parsed;
+    }
+
+    parsed = new table();
+    unsigned skipped = 0;
+    if(!parse(path, source, *parsed, skipped, lines))
+    {
+        delete parsed;
+        return nullptr;
+    }
+    set.skipped += skipped;
+    /* Skipped keybinds keep being reported until they are fixed */
+    if(skipped == 0 && !set.check)
+    {
+        saveBinaryCache(path, sourceHash, source.size, *parsed);
+    }
+    return parsed;
+}
+
+
+bool Keybinds::loadSources(const string& path, sourceSet& set, int depth)
+{
+    /* A file included twice is only loaded the first time */
+    if(find(set.paths.begin(), set.paths.end(), path) != set.paths.end())
+    {
+        return true;
+    }
+    if(depth > MAX_INCLUDE_DEPTH)
+    {
+        logger.error("Includes nested more than " + to_string(MAX_INCLUDE_DEPTH) + " deep at " + path + ", is there an include cycle?");
+        return false;
+    }
+
+    vector<uint32_t> lines;
+    table* loaded = loadFile(path, set, set.check ? &lines : nullptr);
+    if(!loaded)
+    {
+        return false;
+    }
+
+    /* Includes come first so the including file overrides them */
+    size_t slash = path.rfind('/');
+    string directory = slash == string::npos ? "" : path.substr(0, slash + 1);
+    size_t start = 0;
+    for(size_t end; (end = loaded->includes.find('\n', start)) != string::npos; start = end + 1)
+    {
+        string include = loaded->includes.substr(start, end - start);
+        if(!loadSources(include[0] == '/' ? include : directory + include, set, depth + 1))
+        {
+            delete loaded;
+            return false;
+        }
+    }
+
+    set.parts.push_back(loaded);
+    set.paths.push_back(path);
+    set.lines.push_back(move(lines));
+    return true;
+}
+
+
+string Keybinds::dropInDirectory()
+{
+    size_t slash = file.rfind('/');
+    size_t dot = file.rfind('.');
+    bool extension = dot != string::npos && (slash == string::npos || dot > slash);
+    return (extension ? file.substr(0, dot) : file) + DROP_IN_SUFFIX;
+}
+
+
+bool Keybinds::loadDropIns(sourceSet& set)
+{
+    string directory = dropInDirectory();
+    DIR* dir = opendir(directory.c_str());
+    if(!dir)
+    {
+        /* No drop-in directory, nothing to add */
+        return true;
+    }
+    vector<string> names;
+    struct dirent* entry;
+    while((entry = readdir(dir)) != nullptr)
+    {
+        string name = entry->d_name;
+        if(name.size() > 5 && name[0] != '.' && name.compare(name.size() - 5, 5, ".json") == 0)
+        {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    sort(names.begin(), names.end());
+    for(const auto& name : names)
+    {
+        if(!loadSources(directory + "/" + name, set, 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+Keybinds::table* Keybinds::merge(sourceSet& set, vector<pair<uint32_t, uint32_t>>* origins)
+{
+    /* origins: (source, action in that source) of every merged action, for --check */
+    if(set.parts.size() == 1 && !origins)
+    {
+        table* only = set.parts[0];
+        set.parts.clear();
+        return only;
+    }
+
+    /* The last source binding a signature (keys + layer) owns it */
+    unordered_map<uint64_t, uint32_t> owner;
+    size_t total = 0;
+    for(uint32_t part = 0; part < set.parts.size(); part++)
+    {
+        for(const auto& cached : set.parts[part]->cache)
+        {
+            owner[cached.signature] = part;
+        }
+        total += set.parts[part]->cache.size();
+    }
+
+    table* merged = new table();
+    merged->cache.reserve(total);
+    for(uint32_t part = 0; part < set.parts.size(); part++)
+    {
+        const table& source = *set.parts[part];
+        for(uint32_t a = 0; a < source.cache.size(); a++)
+        {
+            if(owner[source.cache[a].signature] != part)
+            {
+                continue;
+            }
+            action copied = source.cache[a];
+            copied.commandOffset = merged->strings.size();
+            merged->strings.append(source.strings, source.cache[a].commandOffset, table::stringLength(copied));
+            merged->cache.push_back(copied);
+            if(origins)
+            {
+                origins->push_back({part, a});
+            }
+        }
+        /* Union of the layer names, in order of appearance */
+        size_t start = 0;
+        for(size_t end; (end = source.layers.find('\n', start)) != string::npos; start = end + 1)
+        {
+            string line = source.layers.substr(start, end - start + 1);
+            if(("\n" + merged->layers).find("\n" + line) == string::npos)
+            {
+                merged->layers += line;
+            }
+        }
+        delete set.parts[part];
+    }
+    set.parts.clear();
+    buildIndex(*merged);
+    return merged;
+}
+
+
+Keybinds::table* Keybinds::compile(table* parsed)
+{
+    /* One block for every state, each action holds an aliasing pointer into it */
+    size_t count = parsed->cache.size();
+    shared_ptr<actionState[]> block(new actionState[count ? count : 1]);
+    parsed->states.resize(count);
+    for(size_t a = 0; a < count; a++)
+    {
+        parsed->states[a] = shared_ptr<actionState>(block, &block[a]);
+    }
+    return parsed;
+}
+
+
+Keybinds::table* Keybinds::loadBinaryCache(const string& sourcePath, uint64_t sourceHash, size_t sourceSize)
+{
+    string path = sourcePath + BINARY_CACHE_SUFFIX;
+    mappedFile mapped;
+    if(!mapped.open(path.c_str()) || mapped.size < sizeof(binaryCacheHeader))
+    {
+        return nullptr;
+    }
+
+    const char* data = mapped.data;
+    size_t size = mapped.size;
+    binaryCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    size_t actionBytes = header.actionCount * sizeof(action);
+    size_t slotBytes = header.indexCapacity * sizeof(slot);
+
+    bool valid = memcmp(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == BINARY_CACHE_VERSION
+        && header.actionSize == sizeof(action) && header.slotSize == sizeof(slot)
+        && header.sourceSize == sourceSize
+        && header.sourceHash == sourceHash
+        && header.indexCapacity > 0 && (header.indexCapacity & (header.indexCapacity - 1)) == 0
+        && sizeof(header) + actionBytes + slotBytes + header.stringBytes + header.layerBytes + header.includeBytes == size
+        && header.checksum == bulkHash(data + sizeof(header), size - sizeof(header));
+
+    table* loaded = nullptr;
+    if(valid)
+    {
+        loaded = new table();
+        const char* section = data + sizeof(header);
+        loaded->cache.resize(header.actionCount);
+        memcpy((void*)loaded->cache.data(), section, actionBytes);
+        section += actionBytes;
+        loaded->index.resize(header.indexCapacity);
+        memcpy((void*)loaded->index.data(), section, slotBytes);
+        section += slotBytes;
+        loaded->indexMask = header.indexCapacity - 1;
+        loaded->strings.assign(section, header.stringBytes);
+        section += header.stringBytes;
+        loaded->layers.assign(section, header.layerBytes);
+        section += header.layerBytes;
+        loaded->includes.assign(section, header.includeBytes);
+    }
+    return loaded;
+}
+
+
+void Keybinds::saveBinaryCache(const string& sourcePath, uint64_t sourceHash, size_t sourceSize, const table& compiled)
+{
+    /* Written next to the source and renamed into place, a reader never sees a partial file */
+    string path = sourcePath + BINARY_CACHE_SUFFIX;
+    string temporary = path + ".tmp";
+
+    size_t actionBytes = compiled.cache.size() * sizeof(action);
+    size_t slotBytes = compiled.index.size() * sizeof(slot);
+    string payload;
+    payload.reserve(actionBytes + slotBytes + compiled.strings.size() + compiled.layers.size() + compiled.includes.size());
+    payload.append((const char*)compiled.cache.data(), actionBytes);
+    payload.append((const char*)compiled.index.data(), slotBytes);
+    payload += compiled.strings;
+    payload += compiled.layers;
+    payload += compiled.includes;
+
+    binaryCacheHeader header = {};
+    memcpy(header.magic, BINARY_CACHE_MAGIC, sizeof(header.magic));
+    header.version = BINARY_CACHE_VERSION;
+    header.actionSize = sizeof(action);
+    header.slotSize = sizeof(slot);
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    header.checksum = bulkHash(payload.data(), payload.size());
+    header.actionCount = compiled.cache.size();
+    header.indexCapacity = compiled.index.size();
+    header.stringBytes = compiled.strings.size();
+    header.layerBytes = compiled.layers.size();
+    header.includeBytes = compiled.includes.size();
+
+    ofstream output(temporary, ios::binary | ios::trunc);
+    output.write((const char*)&header, sizeof(header));
+    output.write(payload.data(), payload.size());
+    output.close();
+    if(!output || rename(temporary.c_str(), path.c_str()) < 0)
+    {
+        logger.error("Unable to write binary cache: " + path);
+        unlink(temporary.c_str());
+    }
+}
+
+
+Keybinds::slot* Keybinds::findSlot(table& compiled, uint64_t signature)
+{
+    for(uint64_t i = signature & compiled.indexMask; compiled.index[i].first != NO_ACTION; i = (i + 1) & compiled.indexMask)
+    {
+        if(compiled.index[i].signature == signature)
+        {
+            return &compiled.index[i];
+        }
+    }
+    return nullptr;
+}
+
+
+uint32_t Keybinds::findAction(const table& compiled, const action& wanted)
+{
+    const vector<action>& cache = compiled.cache;
+    slot* found = findSlot(const_cast<table&>(compiled), wanted.signature);
+    if(!found)
+    {
+        return NO_ACTION;
+    }
+    for(uint32_t a = found->first; a < REMOVED_ACTIONS; a = cache[a].next)
+    {
+        if(cache[a].ordinal == wanted.ordinal && cache[a].layer == wanted.layer && cache[a].keyCount == wanted.keyCount
+            && equal(wanted.keys, wanted.keys + wanted.keyCount, cache[a].keys))
+        {
+            return a;
+        }
+    }
+    return NO_ACTION;
+}
+
+
+Keybinds::table* Keybinds::patch(const table& old, table& parsed)
+{
+    /*
+        1. Match every parsed keybind with the current one of the same identity
+            - Same content: unchanged, nothing to do
+            - Different content: changed, replaced in place with a fresh state
+            - Not found: added
+        2. Every current keybind that was not matched is removed
+        3. Apply those changes to a copy of the table, the current one is still in use by the listener
+    */
+    vector<bool> kept(old.cache.size(), false);
+    vector<pair<uint32_t, uint32_t>> changed; // (old action, parsed action)
+    vector<uint32_t> added;
+    size_t unchanged = 0;
+
+    for(uint32_t p = 0; p < parsed.cache.size(); p++)
+    {
+        uint32_t a = findAction(old, parsed.cache[p]);
+        if(a == NO_ACTION)
+        {
+            added.push_back(p);
+            continue;
+        }
+        kept[a] = true;
+        if(old.cache[a].content == parsed.cache[p].content)
+        {
+            unchanged++;
+        }
+        else
+        {
+            changed.push_back({a, p});
+        }
+    }
+
+    vector<uint32_t> removed;
+    size_t live = 0;
+    for(uint32_t a = 0; a < old.cache.size(); a++)
+    {
+        if(old.cache[a].removed)
+        {
+            continue;
+        }
+        live++;
+        if(!kept[a])
+        {
+            removed.push_back(a);
+        }
+    }
+
+    if(added.empty() && removed.empty() && changed.empty())
+    {
+        return nullptr;
+    }
+    logger.log("Reload: " + to_string(added.size()) + " added, " + to_string(removed.size()) + " removed, "
+        + to_string(changed.size()) + " changed, " + to_string(unchanged) + " unchanged");
+
+    table* patched = new table(old);
+    vector<action>& cache = patched->cache;
+    patched->layers = parsed.layers;
+
+    /* Commands of changed and added keybinds are appended to the string pool, compaction drops the old ones */
+    auto copyCommand = [&](action& target, const action& source) {
+        target.commandOffset = patched->strings.size();
+        patched->strings.append(parsed.strings, source.commandOffset, table::stringLength(source));
+    };
+
+    for(const auto& change : changed)
+    {
+        /* Same identity, so the same place in the index: take everything but the chain link */
+        action& target = cache[change.first];
+        action updated = parsed.cache[change.second];
+        updated.next = target.next;
+        copyCommand(updated, parsed.cache[change.second]);
+        target = updated;
+        patched->states[change.first] = make_shared<actionState>();
+    }
+
+    for(uint32_t a : removed)
+    {
+        /* Unlink from its chain, an emptied slot stays a probe step but no longer matches */
+        slot* found = findSlot(*patched, cache[a].signature);
+        if(found->first == a)
+        {
+            found->first = cache[a].next == NO_ACTION ? REMOVED_ACTIONS : cache[a].next;
+        }
+        else
+        {
+            uint32_t previous = found->first;
+            while(cache[previous].next != a)
+            {
+                previous = cache[previous].next;
+            }
+            cache[previous].next = cache[a].next;
+        }
+        cache[a].removed = true;
+        patched->states[a].reset();
+    }
+
+    for(uint32_t p : added)
+    {
+        action newAction = parsed.cache[p];
+        newAction.next = NO_ACTION;
+        copyCommand(newAction, parsed.cache[p]);
+        cache.push_back(newAction);
+        patched->states.push_back(make_shared<actionState>());
+    }
+
+    size_t tombstones = cache.size() - (live - removed.size() + added.size());
+    if(tombstones > cache.size() / 2 || cache.size() * 2 > patched->index.size())
+    {
+        /* Too many tombstones or the index is getting full: compact and index from scratch */
+        table* compacted = new table();
+        compacted->layers = patched->layers;
+        for(size_t a = 0; a < cache.size(); a++)
+        {
+            if(cache[a].removed)
+            {
+                continue;
+            }
+            action survivor = cache[a];
+            survivor.commandOffset = compacted->strings.size();
+            compacted->strings.append(patched->strings, cache[a].commandOffset, table::stringLength(cache[a]));
+            compacted->cache.push_back(survivor);
+            compacted->states.push_back(patched->states[a]);
+        }
+        delete patched;
+        buildIndex(*compacted);
+        return compacted;
+    }
+
+    for(uint32_t a = cache.size() - added.size(); a < cache.size(); a++)
+    {
+        /* Append to the end of the chain, or take over the first empty or emptied slot of the signature */
+        slot* found = findSlot(*patched, cache[a].signature);
+        if(found && found->first != REMOVED_ACTIONS)
+        {
+            uint32_t last = found->first;
+            while(cache[last].next != NO_ACTION)
+            {
+                last = cache[last].next;
+            }
+            cache[last].next = a;
+            continue;
+        }
+        if(!found)
+        {
+            uint64_t i = cache[a].signature & patched->indexMask;
+            while(patched->index[i].first != NO_ACTION)
+            {
+                i = (i + 1) & patched->indexMask;
+            }
+            found = &patched->index[i];
+            found->signature = cache[a].signature;
+        }
+        found->first = a;
+    }
+    return patched;
+}
+
+
+void Keybinds::startWatcher()
+{
+    thread(&Keybinds::watch, this).detach();
+}
+
+
+void Keybinds::watch()
+{
+    /*
+        - Watch the directories, not the files
+            - Editors that save through a temporary file and rename it over keybinds.json replace the inode,
+              a watch on the file itself would be lost after the first save
+        - Every directory with a source, and keybinds.d/ for new drop-ins, added again after each reload for new includes
+        - IN_CLOSE_WRITE: written in place, IN_MOVED_TO: renamed over, IN_DELETE / IN_MOVED_FROM: a drop-in went away
+    */
+    int fd = inotify_init1(IN_CLOEXEC);
+    if(fd < 0)
+    {
+        logger.error("Unable to watch " + file + " for changes");
+        return;
+    }
+    string dropIns = dropInDirectory();
+    string dropInName = dropIns.substr(dropIns.rfind('/') + 1);
+    auto addWatches = [&]() {
+        vector<string> paths = sources;
+        paths.push_back(file);
+        paths.push_back(dropIns + "/");
+        bool watching = false;
+        for(const auto& path : paths)
+        {
+            size_t slash = path.rfind('/');
+            string directory = slash == string::npos ? "." : path.substr(0, slash + 1);
+            watching |= inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_CREATE) >= 0;
+        }
+        return watching;
+    };
+    if(!addWatches())
+    {
+        logger.error("Unable to watch " + file + " for changes");
+        close(fd);
+        return;
+    }
+
+    alignas(struct inotify_event) char buffer[4096];
+    while(true)
+    {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if(length <= 0)
+        {
+            logger.error("Stopped watching " + file + " for changes");
+            close(fd);
+            return;
+        }
+
+        /* Any source by name, any *.json (a drop-in or a new include), or keybinds.d/ being created */
+        bool changed = false;
+        for(char* p = buffer; p < buffer + length;)
+        {
+            struct inotify_event* event = (struct inotify_event*)p;
+            string name = event->len > 0 ? event->name : "";
+            changed |= name == dropInName;
+            if(event->len > 0 && !(event->mask & IN_CREATE))
+            {
+                changed |= name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0;
+                for(const auto& path : sources)
+                {
+                    changed |= path.size() >= name.size() && path.compare(path.size() - name.size(), name.size(), name) == 0
+                        && (path.size() == name.size() || path[path.size() - name.size() - 1] == '/');
+                }
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        if(!changed)
+        {
+            continue;
+        }
+
+        /* Editors may touch the file several times per save, let them settle and drop the rest of the burst */
+        usleep(RELOAD_SETTLE_US);
+        struct pollfd pending = { fd, POLLIN, 0 };
+        while(poll(&pending, 1, 0) > 0 && read(fd, buffer, sizeof(buffer)) > 0) {}
+
+        reloadCache();
+        addWatches();
+    }
+}
+
+
+/*
+    --------------------
+    | Keybinds Parser  |
+    --------------------
+*/
+
+/*
+    - Streams keybinds.json through the nlohmann SAX interface, no DOM is built
+        - Every keybind object is turned into an action as soon as it is closed
+        - Memory stays proportional to the compiled table, not to the file
+    - The file is either an array of keybinds, or an object with the includes, the keybinds and the named layers
+        - { "include": [ "team.json" ], "keybinds": [ ... ], "layers": { "media": [ ... ], "gaming": [ ... ] } }
+    - Values inside a keybind are reported as fields named after their path, array levels left out
+        - { "keybind": [ { "key": 29 } ] } --> field "keybind.key"
+    - Errors are reported with their line and column
+        - An invalid keybind is skipped, the rest of the file still loads
+        - A syntax error rejects the whole file
+*/
+
+/* Iterator over the mapped source that remembers how far the parser has read, for line and column numbers */
+struct trackingIterator
+{
+    using iterator_category = input_iterator_tag;
+    using value_type = char;
+    using difference_type = ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+
+    const char* current;
+    const char** furthest;
+
+    reference operator*() const
+    {
+        return *current;
+    }
+    trackingIterator& operator++()
+    {
+        *furthest = ++current;
+        return *this;
+    }
+    bool operator==(const trackingIterator& other) const
+    {
+        return current == other.current;
+    }
+    bool operator!=(const trackingIterator& other) const
+    {
+        return current != other.current;
+    }
+};
+
+class KeybindsParser
+{
+    public:
+        KeybindsParser(Keybinds& _keybinds, Keybinds::table& _parsed, const std::string& _path, const mappedFile& _source)
+            : keybinds(_keybinds), parsed(_parsed), path(_path), source(_source), read(_source.data), lineStart(_source.data) {}
+
+        bool parse();
+
+        /* nlohmann SAX interface */
+        bool null() { return value(scalar()); }
+        bool boolean(bool flag) { scalar v; v.type = scalar::BOOLEAN; v.boolean = flag; return value(v); }
+        bool number_integer(json::number_integer_t number) { return value(scalar(number)); }
+        bool number_unsigned(json::number_unsigned_t number) { return value(scalar(number)); }
+        bool number_float(json::number_float_t number, const string&) { scalar v(0); v.real = number; v.integral = false; return value(v); }
+        bool string(std::string& text) { scalar v; v.type = scalar::STRING; v.text = move(text); return value(v); }
+        bool binary(json::binary_t&) { return value(scalar()); }
+        bool start_object(size_t);
+        bool key(std::string& name);
+        bool end_object();
+        bool start_array(size_t);
+        bool end_array();
+        bool parse_error(size_t position, const std::string& lastToken, const nlohmann::detail::exception& ex);
+
+        /* Keybinds skipped because of an error */
+        unsigned errors = 0;
+        /* Optional, receives the line of every accepted keybind */
+        vector<uint32_t>* lines = nullptr;
+    private:
+        struct scalar
+        {
+            enum { NUL, BOOLEAN, NUMBER, STRING } type = NUL;
+            long long number = 0;
+            double real = 0;
+            bool integral = true;
+            bool boolean = false;
+            std::string text;
+
+            scalar() {}
+            scalar(long long _number) : type(NUMBER), number(_number), real(_number) {}
+        };
+        struct container
+        {
+            bool array;
+            /* Key of this container in its parent object, empty for array elements */
+            std::string name;
+        };
+
+        Keybinds& keybinds;
+        Keybinds::table& parsed;
+        const std::string& path;
+        const mappedFile& source;
+
+        vector<container> stack;
+        std::string currentKey;
+        /* Stack depth of the keybind object being read, -1 outside of a keybind */
+        int bindingLevel = -1;
+        /* layerSignature of the keybind list being read */
+        uint64_t currentLayer = 0;
+
+        /* Keybind being read */
+        Keybinds::action binding;
+        std::string command;
+        bool hasCommand;
+        /* Bit per TRIGGER_, press when none is given */
+        uint8_t triggers;
+        /* Only for the tap and hold actions of the keybind */
+        uint8_t taps;
+        uint32_t hold;
+        /* Macro name or text of the keybind */
+        std::string actionText;
+        std::string hotstring;
+        /* Keys of a dual-role key, -1 when not given */
+        int tapKey;
+        int holdKey;
+        bool valid;
+        uint32_t bindingLine;
+        /* Occurrences per keybind signature so far, gives every action its ordinal */
+        unordered_map<uint64_t, uint16_t> occurrences;
+
+        /* Position: furthest byte read by the parser, line counting continues from the last error */
+        const char* read;
+        const char* lineStart;
+        const char* counted = nullptr;
+        int line = 1;
+
+        bool isKeybindList(size_t level);
+        uint64_t enterLayer(const std::string& name);
+        void setLayerOp(uint8_t op, const scalar& v);
+        void countLines();
+        std::string location();
+        void error(const std::string& message);
+        std::string fieldName();
+        bool value(const scalar& v);
+        void field(const std::string& name, const scalar& v);
+        /* emitted: keys sent by the keybind ("remap"), kept in the order they are written */
+        void addKey(long long code, bool emitted = false);
+        /* Key code or modifier class (KEY_CLASS_FIRST...) */
+        void insertKey(uint16_t keyInt, bool emitted);
+        void addKeys(const std::string& chord, bool emitted = false);
+        void addCharacter(const std::string& character, bool emitted);
+        void beginBinding();
+        void endBinding();
+};
+
+bool KeybindsParser::parse()
+{
+    trackingIterator first = { source.data, &read };
+    trackingIterator last = { source.data + source.size, &read };
+    return json::sax_parse(first, last, this);
+}
+
+void KeybindsParser::countLines()
+{
+    /* Positions are asked for in file order, so only the part since the previous one has to be scanned */
+    if(!counted)
+    {
+        counted = source.data;
+    }
+    for(; counted < read; counted++)
+    {
+        if(*counted == '\n')
+        {
+            line++;
+            lineStart = counted + 1;
+        }
+    }
+}
+
+std::string KeybindsParser::location()
+{
+    countLines();
+    return path + ":" + to_string(line) + ":" + to_string(read - lineStart + 1);
+}
+
+void KeybindsParser::error(const std::string& message)
+{
+    keybinds.logger.error(location() + ": " + message);
+    errors += valid;
+    valid = false;
+}
+
+std::string KeybindsParser::fieldName()
+{
+    std::string name;
+    for(size_t level = bindingLevel + 1; level < stack.size(); level++)
+    {
+        if(!stack[level].name.empty())
+        {
+            name += (name.empty() ? "" : ".") + stack[level].name;
+        }
+    }
+    if(!stack.empty() && !stack.back().array)
+    {
+        name += (name.empty() ? "" : ".") + currentKey;
+    }
+    return name;
+}
+
+bool KeybindsParser::isKeybindList(size_t level)
+{
+    /*
+        - [ keybind, ... ]
+        - { "keybinds": [ keybind, ... ], "layers": { "name": [ keybind, ... ] } }
+    */
+    if(!stack[level].array)
+    {
+        return false;
+    }
+    if(level == 0)
+    {
+        return true;
+    }
+    if(stack[0].array)
+    {
+        return false;
+    }
+    return (level == 1 && stack[1].name == "keybinds") || (level == 2 && stack[1].name == "layers" && !stack[1].array);
+}
+
+uint64_t KeybindsParser::enterLayer(const std::string& name)
+{
+    if(name.empty() || name.find('\n') != std::string::npos)
+    {
+        keybinds.logger.error(location() + ": invalid layer name \"" + name + "\"");
+        return 0;
+    }
+    if(("\n" + parsed.layers).find("\n" + name + "\n") == std::string::npos)
+    {
+        parsed.layers += name + "\n";
+    }
+    return layerSignature(name.data(), name.size());
+}
+
+bool KeybindsParser::start_object(size_t)
+{
+    bool array = stack.empty() || stack.back().array;
+    stack.push_back({false, array ? "" : currentKey});
+    if(bindingLevel >= 0 || stack.size() == 1)
+    {
+        return true;
+    }
+    if(isKeybindList(stack.size() - 2))
+    {
+        bindingLevel = stack.size() - 1;
+        beginBinding();
+        return true;
+    }
+    if(stack.size() == 2 && stack[1].name == "layers")
+    {
+        return true;
+    }
+    keybinds.logger.error(location() + ": expected an array of keybinds");
+    return false;
+}
+
+bool KeybindsParser::key(std::string& name)
+{
+    currentKey = move(name);
+    return true;
+}
+
+bool KeybindsParser::end_object()
+{
+    if((int)stack.size() - 1 == bindingLevel)
+    {
+        endBinding();
+        bindingLevel = -1;
+    }
+    stack.pop_back();
+    return true;
+}
+
+bool KeybindsParser::start_array(size_t)
+{
+    bool array = stack.empty() || stack.back().array;
+    stack.push_back({true, array ? "" : currentKey});
+    if(bindingLevel >= 0)
+    {
+        return true;
+    }
+    if(isKeybindList(stack.size() - 1))
+    {
+        currentLayer = stack.size() == 3 ? enterLayer(stack[2].name) : 0;
+        return stack.size() != 3 || currentLayer != 0;
+    }
+    if(stack.size() == 2 && !stack[0].array && stack[1].name == "include")
+    {
+        return true;
+    }
+    keybinds.logger.error(location() + (stack.size() == 2 && stack[0].array ? ": expected a keybind object" : ": expected an array of keybinds"));
+    return false;
+}
+
+bool KeybindsParser::end_array()
+{
+    stack.pop_back();
+    return true;
+}
+
+bool KeybindsParser::value(const scalar& v)
+{
+    bool include = !stack.empty() && !stack[0].array
+        && ((stack.size() == 1 && currentKey == "include") || (stack.size() == 2 && stack[1].name == "include"));
+    if(include)
+    {
+        if(v.type != scalar::STRING || v.text.empty() || v.text.find('\n') != std::string::npos)
+        {
+            keybinds.logger.error(location() + ": \"include\" must be a file name or an array of file names");
+            return false;
+        }
+        parsed.includes += v.text + "\n";
+        return true;
+    }
+    if(bindingLevel < 0)
+    {
+        bool list = !stack.empty() && isKeybindList(stack.size() - 1);
+        keybinds.logger.error(location() + (list ? ": expected a keybind object" : ": expected an array of keybinds"));
+        return false;
+    }
+    field(fieldName(), v);
+    return true;
+}
+
+bool KeybindsParser::parse_error(size_t, const std::string&, const nlohmann::detail::exception& ex)
+{
+    /* The nlohmann message already carries the line and column */
+    keybinds.logger.error("Unable to parse " + path + ": " + ex.what());
+    return false;
+}
+
+void KeybindsParser::beginBinding()
+{
+    binding = {};
+    binding.next = NO_ACTION;
+    binding.layer = currentLayer;
+    binding.signature = currentLayer;
+    command.clear();
+    actionText.clear();
+    hotstring.clear();
+    hasCommand = false;
+    triggers = 0;
+    taps = 0;
+    hold = 0;
+    tapKey = -1;
+    holdKey = -1;
+    valid = true;
+    if(lines)
+    {
+        countLines();
+        bindingLine = line;
+    }
+}
+
+void KeybindsParser::field(const std::string& name, const scalar& v)
+{
+    if(!valid)
+    {
+        return;
+    }
+    if(name == "command")
+    {
+        if(v.type != scalar::STRING)
+        {
+            error("\"command\" must be a string");
+            return;
+        }
+        command = v.text;
+        hasCommand = true;
+    }
+    else if(name == "keybind.key" || name == "keybind")
+    {
+        /*
+            - { "key": 29 } or { "key": "KEY_LEFTCTRL" }
+            - "keybind": "ctrl+right", or an array of such strings or of key codes
+        */
+        if(v.type == scalar::STRING)
+        {
+            addKeys(v.text);
+        }
+        else if(v.type == scalar::NUMBER && v.integral)
+        {
+            addKey(v.number);
+        }
+        else
+        {
+            error("Invalid key in keybind, expected a key code or a key name");
+        }
+    }
+    else if(name == "trigger")
+    {
+        /* "trigger": "release", or an array like [ "press", "repeat" ] */
+        int trigger = TRIGGER_COUNT;
+        while(v.type == scalar::STRING && trigger-- > 0 && v.text != triggerNames[trigger]) {}
+        if(v.type != scalar::STRING || trigger < 0)
+        {
+            error("Invalid trigger, expected \"press\", \"release\", \"repeat\", \"tap\" or \"hold\"");
+            return;
+        }
+        triggers |= 1 << trigger;
+    }
+    else if(name == "ordered")
+    {
+        /* The keys have to be pressed in the order they are written */
+        if(v.type != scalar::BOOLEAN)
+        {
+            error("\"ordered\" must be true or false");
+            return;
+        }
+        binding.ordered = v.boolean;
+    }
+    else if(name == "window")
+    {
+        /* Milliseconds between the first and the last press */
+        if(v.type != scalar::NUMBER || v.real <= 0 || v.real * 1000 > UINT32_MAX)
+        {
+            error("\"window\" must be a positive number of milliseconds");
+            return;
+        }
+        binding.window = v.real * 1000;
+    }
+    else if(name == "taps")
+    {
+        /* Number of taps in a row, implies the tap trigger */
+        if(v.type != scalar::NUMBER || !v.integral || v.number < 1 || v.number > UINT8_MAX)
+        {
+            error("\"taps\" must be a number of taps between 1 and " + to_string(UINT8_MAX));
+            return;
+        }
+        taps = v.number;
+        triggers |= 1 << TRIGGER_TAP;
+    }
+    else if(name == "tap" || (name == "hold" && v.type == scalar::STRING))
+    {
+        /* "tap": "esc", "hold": "leftctrl" makes the key a dual-role key */
+        int code = v.type == scalar::STRING ? keyCode(v.text.data(), v.text.size()) : v.type == scalar::NUMBER && v.integral && v.number < KEY_CNT ? v.number : -1;
+        if(code <= 0)
+        {
+            error("\"" + name + "\" of a dual-role key must be a key name or code");
+            return;
+        }
+        (name == "tap" ? tapKey : holdKey) = code;
+    }
+    else if(name == "hold")
+    {
+        /* Milliseconds the keys have to be held, implies the hold trigger */
+        if(v.type != scalar::NUMBER || v.real <= 0 || v.real * 1000 > UINT32_MAX)
+        {
+            error("\"hold\" must be a positive number of milliseconds, or the key of a dual-role key");
+            return;
+        }
+        hold = v.real * 1000;
+        triggers |= 1 << TRIGGER_HOLD;
+    }
+    else if(name == "remap" || name == "emit")
+    {
+        /*
+            - "remap": "esc" or "ctrl+shift+t", or an array of key names or codes, pressed in that order
+            - "emit": the same, but tapped when the keybind runs, like any other action
+        */
+        uint8_t output = name == "remap" ? OUTPUT_REMAP : OUTPUT_EMIT;
+        if(binding.output != OUTPUT_NONE && binding.output != output)
+        {
+            error("Only one of \"remap\" and \"emit\" per keybind");
+            return;
+        }
+        binding.output = output;
+        if(v.type == scalar::STRING)
+        {
+            addKeys(v.text, true);
+        }
+        else if(v.type == scalar::NUMBER && v.integral)
+        {
+            addKey(v.number, true);
+        }
+        else
+        {
+            error("Invalid key in " + name + ", expected a key code or a key name");
+        }
+    }
+    else if(name == "record" || name == "play")
+    {
+        /* "record": "name" records the macro, "play": "name" plays it */
+        if(v.type != scalar::STRING || v.text.empty())
+        {
+            error("\"" + name + "\" must be the name of a macro");
+            return;
+        }
+        if(binding.macroOp != MACRO_NONE)
+        {
+            error("Only one of \"record\", \"play\", \"type\" and \"typeFile\" per keybind");
+            return;
+        }
+        binding.macroOp = name == "record" ? MACRO_RECORD : MACRO_PLAY;
+        actionText = v.text;
+    }
+    else if(name == "type" || name == "typeFile")
+    {
+        /* "type": "text", "typeFile": "secret.txt" relative to this file */
+        if(v.type != scalar::STRING || v.text.empty())
+        {
+            error("\"" + name + "\" must be a" + (name == "type" ? " text" : " file name"));
+            return;
+        }
+        if(binding.macroOp != MACRO_NONE)
+        {
+            error("Only one of \"record\", \"play\", \"type\" and \"typeFile\" per keybind");
+            return;
+        }
+        binding.macroOp = name == "type" ? MACRO_TYPE : MACRO_TYPE_FILE;
+        actionText = v.text;
+        if(binding.macroOp == MACRO_TYPE_FILE && v.text[0] != '/')
+        {
+            /* Stored absolute, the cache is shared by every working directory the config is loaded from */
+            size_t slash = path.rfind('/');
+            char* directory = realpath(slash == std::string::npos ? "." : path.substr(0, slash + 1).c_str(), nullptr);
+            if(!directory)
+            {
+                error("Failed to resolve the directory of \"" + v.text + "\"");
+                return;
+            }
+            actionText = std::string(directory) + "/" + v.text;
+            free(directory);
+        }
+    }
+    else if(name == "speed")
+    {
+        /* Playback speed, 2 is twice as fast, kept as whole percents: rounded first so 0.01 is 1% and not 0.99...% */
+        double percent = v.type == scalar::NUMBER ? floor(v.real * 100 + 0.5) : 0;
+        if(percent < 1 || percent > MAX_MACRO_SPEED)
+        {
+            error("\"speed\" must be a number between 0.01 and " + to_string(MAX_MACRO_SPEED / 100));
+            return;
+        }
+        binding.speed = percent;
+    }
+    else if(name == "hotstring")
+    {
+        /* ";sig" runs the keybind when it is typed, in ASCII characters of the keyboard layout */
+        bool typeable = v.type == scalar::STRING && !v.text.empty() && v.text.size() <= MAX_HOTSTRING_LENGTH;
+        for(size_t c = 0; typeable && c < v.text.size(); c++)
+        {
+            typeable = (unsigned char)v.text[c] < 128 && keybinds.layout.key(v.text[c]) != 0;
+        }
+        if(!typeable)
+        {
+            error("\"hotstring\" must be up to " + to_string(MAX_HOTSTRING_LENGTH) + " characters of the keyboard");
+            return;
+        }
+        hotstring = v.text;
+    }
+    else if(name == "passthrough")
+    {
+        /* --grab: pass the keys on even when they run the keybind */
+        if(v.type != scalar::BOOLEAN)
+        {
+            error("\"passthrough\" must be true or false");
+            return;
+        }
+        binding.passthrough = v.boolean;
+    }
+    else if(name == "push")
+    {
+        setLayerOp(LAYER_PUSH, v);
+    }
+    else if(name == "pop")
+    {
+        setLayerOp(LAYER_POP, v);
+    }
+    else if(name == "toggle")
+    {
+        setLayerOp(LAYER_TOGGLE, v);
+    }
+    /* "keybind.modifier" and unknown fields are ignored */
+}
+
+void KeybindsParser::setLayerOp(uint8_t op, const scalar& v)
+{
+    /* "push": "media", "toggle": "media", "pop": "media" or "pop": true to leave the layer of the keybind (the top layer from the base layer) */
+    if(binding.layerOp != LAYER_NONE)
+    {
+        error("Only one of \"push\", \"pop\" and \"toggle\" per keybind");
+    }
+    else if(v.type == scalar::STRING && !v.text.empty())
+    {
+        binding.layerOp = op;
+        binding.target = layerSignature(v.text.data(), v.text.size());
+    }
+    else if(op == LAYER_POP && v.type == scalar::BOOLEAN && v.boolean)
+    {
+        binding.layerOp = op;
+        binding.target = currentLayer;
+    }
+    else
+    {
+        error(op == LAYER_POP ? "\"pop\" must be a layer name or true" : "Expected a layer name");
+    }
+}
+
+void KeybindsParser::addKey(long long code, bool emitted)
+{
+    if(code < 0 || code >= KEY_CNT)
+    {
+        error("Invalid key " + to_string(code) + " in keybind, expected a key code between 0 and " + to_string(KEY_CNT - 1));
+        return;
+    }
+    insertKey(code, emitted);
+}
+
+void KeybindsParser::insertKey(uint16_t keyInt, bool emitted)
+{
+    uint16_t* keys = emitted ? binding.emit : binding.keys;
+    uint8_t& count = emitted ? binding.emitCount : binding.keyCount;
+    if(find(keys, keys + count, keyInt) != keys + count)
+    {
+        return;
+    }
+    if(count == MAX_CHORD_KEYS)
+    {
+        error(std::string(!emitted ? "Keybind" : binding.output == OUTPUT_EMIT ? "Emit" : "Remap") + " has more than " + to_string(MAX_CHORD_KEYS) + " keys");
+        return;
+    }
+    keys[count++] = keyInt;
+    binding.signature += emitted ? 0 : keySignature(keyInt);
+}
+
+void KeybindsParser::addKeys(const std::string& chord, bool emitted)
+{
+    /* Names, codes or quoted characters ('a', '+') separated by '+', surrounding spaces are ignored */
+    size_t start = 0;
+    while(valid && start <= chord.size())
+    {
+        size_t first = chord.find_first_not_of(' ', start);
+        size_t quoted = first != std::string::npos && chord[first] == '\'' ? chord.find('\'', first + 2) : std::string::npos;
+        size_t end = chord.find('+', quoted == std::string::npos ? start : quoted);
+        end = end == std::string::npos ? chord.size() : end;
+        size_t last = chord.find_last_not_of(' ', end - 1);
+        if(first >= end || last == std::string::npos || last < first)
+        {
+            error("Empty key name in \"" + chord + "\"");
+            return;
+        }
+        std::string token = chord.substr(first, last - first + 1);
+        if(token.find_first_not_of("0123456789") == std::string::npos)
+        {
+            /* Out of range codes are reported here, stoll() would throw */
+            errno = 0;
+            long long code = strtoll(token.c_str(), nullptr, 10);
+            if(errno == ERANGE)
+            {
+                error("Invalid key " + token + " in keybind, expected a key code between 0 and " + to_string(KEY_CNT - 1));
+                return;
+            }
+            addKey(code, emitted);
+        }
+        else if(token.size() > 2 && token[0] == '\'' && token.back() == '\'')
+        {
+            addCharacter(token.substr(1, token.size() - 2), emitted);
+        }
+        else if(!emitted && keyClassCode(token.data(), token.size()) >= 0)
+        {
+            insertKey(keyClassCode(token.data(), token.size()), emitted);
+        }
+        else
+        {
+            int code = keyCode(token.data(), token.size());
+            if(code < 0)
+            {
+                error("Unknown key name \"" + token + "\"");
+                return;
+            }
+            addKey(code, emitted);
+        }
+        start = end + 1;
+    }
+}
+
+void KeybindsParser::addCharacter(const std::string& character, bool emitted)
+{
+    /* The key typing the character in the keyboard layout, with shift and AltGr for the other levels */
+    uint32_t c = 0;
+    uint32_t typed = decodeUtf8(character.data(), character.size(), c) == (int)character.size() ? keybinds.layout.key(c) : 0;
+    if(typed == 0)
+    {
+        error("No key types '" + character + "' in the keyboard layout");
+        return;
+    }
+    if((typed >> 16) & LAYOUT_SHIFT)
+    {
+        /* Either shift in a keybind */
+        insertKey(emitted ? KEY_LEFTSHIFT : KEY_CLASS_FIRST + keyClass(KEY_LEFTSHIFT), emitted);
+    }
+    if((typed >> 16) & LAYOUT_ALTGR)
+    {
+        addKey(KEY_RIGHTALT, emitted);
+    }
+    addKey(typed & 0xFFFF, emitted);
+}
+
+void KeybindsParser::endBinding()
+{
+    bool dual = tapKey >= 0 || holdKey >= 0;
+    bool remap = binding.output == OUTPUT_REMAP;
+    bool emit = binding.output == OUTPUT_EMIT;
+    if(valid && dual && (tapKey < 0 || holdKey < 0 || binding.keyCount != 1 || hasCommand || triggers || binding.layerOp != LAYER_NONE || binding.output != OUTPUT_NONE
+        || binding.macroOp != MACRO_NONE))
+    {
+        error("A dual-role key is one key with a \"tap\" and a \"hold\" key, without command, triggers or layers");
+    }
+    if(valid && remap && (hasCommand || triggers || binding.layerOp != LAYER_NONE || binding.macroOp != MACRO_NONE))
+    {
+        error("A remap sends keys instead of a command, without triggers or layers");
+    }
+    if(valid && binding.speed && binding.macroOp != MACRO_PLAY)
+    {
+        error("\"speed\" is only for keybinds that \"play\" a macro");
+    }
+    if(valid && !dual && !remap && !emit && binding.macroOp == MACRO_NONE && !hasCommand && binding.layerOp == LAYER_NONE)
+    {
+        error("Keybind without a \"command\"");
+    }
+    if(valid && !hotstring.empty() && (binding.keyCount != 0 || triggers || currentLayer != 0 || dual || remap))
+    {
+        error("A hotstring replaces the keys of a keybind, without triggers, and can't be in a layer");
+    }
+    if(valid && binding.keyCount == 0 && hotstring.empty())
+    {
+        error("Keybind without keys");
+    }
+    for(int k = 0; valid && k < binding.keyCount; k++)
+    {
+        if(binding.keys[k] < KEY_CLASS_FIRST)
+        {
+            continue;
+        }
+        const uint16_t* members = classKeys[binding.keys[k] - KEY_CLASS_FIRST];
+        uint16_t* end = binding.keys + binding.keyCount;
+        if(find(binding.keys, end, members[0]) != end || find(binding.keys, end, members[1]) != end)
+        {
+            error("\"" + std::string(classNames[binding.keys[k] - KEY_CLASS_FIRST].name) + "\" already matches the left and the right key");
+        }
+        else if(dual || remap)
+        {
+            /* Remaps and dual-role keys are looked up by the key of the event, there the name is the left key */
+            binding.signature += keySignature(members[0]) - keySignature(binding.keys[k]);
+            binding.keys[k] = members[0];
+        }
+    }
+    if(!valid)
+    {
+        return;
+    }
+    if(dual)
+    {
+        binding.output = OUTPUT_DUAL;
+        binding.emit[0] = tapKey;
+        binding.emit[1] = holdKey;
+        binding.emitCount = 2;
+        binding.signature += outputSignature(OUTPUT_DUAL);
+    }
+    if(remap)
+    {
+        binding.signature += outputSignature(OUTPUT_REMAP);
+    }
+    uint16_t written[MAX_CHORD_KEYS];
+    copy(binding.keys, binding.keys + binding.keyCount, written);
+    sort(binding.keys, binding.keys + binding.keyCount);
+    for(int k = 0; binding.ordered && k < binding.keyCount; k++)
+    {
+        binding.order[k] = find(binding.keys, binding.keys + binding.keyCount, written[k]) - binding.keys;
+    }
+    triggers = triggers ? triggers : 1 << TRIGGER_PRESS;
+    hold = hold ? hold : DEFAULT_HOLD_US;
+    binding.speed = binding.speed ? binding.speed : 100;
+    binding.content = contentHash(command.data(), command.size()) ^ (binding.target * 0x9E3779B97F4A7C15ULL) ^ binding.layerOp
+        ^ ((uint64_t)binding.window << 8) ^ (binding.ordered ? contentHash((const char*)binding.order, sizeof(binding.order)) : 0)
+        ^ ((uint64_t)taps << 40) ^ ((uint64_t)hold * 0xBF58476D1CE4E5B9ULL)
+        ^ (binding.output ? contentHash((const char*)binding.emit, binding.emitCount * sizeof(binding.emit[0])) + binding.output : 0)
+        ^ ((uint64_t)binding.passthrough << 63)
+        ^ (binding.macroOp ? contentHash(actionText.data(), actionText.size()) * binding.speed + binding.macroOp : 0);
+    binding.commandOffset = parsed.strings.size();
+    binding.commandLength = command.size();
+    parsed.strings += command;
+    binding.textLength = actionText.size();
+    parsed.strings += actionText;
+    binding.hotstringLength = hotstring.size();
+    parsed.strings += hotstring;
+    binding.signature += hotstring.empty() ? 0 : hotstringSignature(hotstring.data(), hotstring.size());
+
+    /* One action per trigger, sharing the command */
+    uint64_t keysSignature = binding.signature;
+    for(int trigger = 0; trigger < TRIGGER_COUNT; trigger++)
+    {
+        if(!(triggers & (1 << trigger)))
+        {
+            continue;
+        }
+        binding.trigger = trigger;
+        binding.taps = trigger == TRIGGER_TAP ? taps : 0;
+        binding.hold = trigger == TRIGGER_HOLD ? hold : 0;
+        binding.signature = keysSignature + triggerSignature(trigger);
+        binding.ordinal = occurrences[binding.signature]++;
+        parsed.cache.push_back(binding);
+        if(lines)
+        {
+            lines->push_back(bindingLine);
+        }
+    }
+}
+
+
+bool Keybinds::parse(const string& path, const mappedFile& source, table& parsed, unsigned& skipped, vector<uint32_t>* lines)
+{
+    KeybindsParser parser(*this, parsed, path, source);
+    parser.lines = lines;
+    if(!parser.parse())
+    {
+        return false;
+    }
+    skipped = parser.errors;
+    buildIndex(parsed);
+    return true;
+}
+
+
+/*
+    --------------------
+    | Config Check     |
+    --------------------
+*/
+
+/*
+    - --check compiles keybinds.json and its includes and drop-ins like a reload would and reports, by file and line:
+        - errors: keybinds that are skipped (invalid or unknown keys), keybinds with the same keys in the same layer,
+          they all fire, and keybinds switching to a layer that is not defined
+        - warnings: keybinds whose keys are a subset of another keybind of their layer and trigger, they fire on the way
+          to the bigger one when their keys are pressed first, or on the way back when its other keys are released first
+          (taps and holds never fire on the way),
+          keybinds that never fire because one with fewer modifier classes ("leftctrl+a" before "ctrl+a") matches the same keys,
+          and keys that can't be pressed (KEY_RESERVED or codes without a name)
+    - Subsets are found through the index: every proper subset of a keybind is a signature lookup,
+      at most 2^MAX_CHORD_KEYS per distinct keybind, so the check stays linear in the size of the file
+        - Modifiers are looked up written every way: "leftctrl" also as "ctrl", "ctrl" also as "leftctrl" and "rightctrl"
+    - Exit status: 0 when nothing was found, 1 on errors, 2 on warnings only
+*/
+
+string Keybinds::chordName(const table& parsed, const action& cached)
+{
+    if(cached.hotstringLength)
+    {
+        return "\"" + string(parsed.hotstring(cached), cached.hotstringLength) + "\" (hotstring)";
+    }
+    /* Modifiers first, the way the keybind would be written, prefixed with the layer */
+    string name = cached.layer ? layerName(parsed, cached.layer) + ":" : "";
+    size_t prefix = name.size();
+    for(int pass = 0; pass < 2; pass++)
+    {
+        for(int k = 0; k < cached.keyCount; k++)
+        {
+            int code = cached.keys[k];
+            bool modifier = keyClass(code) >= 0 || code >= KEY_CLASS_FIRST;
+            if(modifier != (pass == 0))
+            {
+                continue;
+            }
+            const char* keyName = keyCodeName(code);
+            name += (name.size() == prefix ? "" : "+") + (keyName ? string(keyName) : to_string(code));
+        }
+    }
+    if(cached.output == OUTPUT_DUAL || cached.output == OUTPUT_REMAP)
+    {
+        return name + (cached.output == OUTPUT_DUAL ? " (dual-role)" : " (remap)");
+    }
+    if(cached.trigger == TRIGGER_PRESS)
+    {
+        return name;
+    }
+    string trigger = triggerNames[cached.trigger];
+    trigger += cached.taps ? " x" + to_string(cached.taps) : cached.hold ? " " + to_string(cached.hold / 1000) + "ms" : "";
+    return name + " (" + trigger + ")";
+}
+
+void Keybinds::checkSubsets(table& parsed, const vector<string>& where, unsigned& warnings)
+{
+    const vector<action>& cache = parsed.cache;
+    auto classMaskOf = [](const action& cached) {
+        unsigned mask = 0;
+        for(int k = 0; k < cached.keyCount; k++)
+        {
+            mask |= cached.keys[k] >= KEY_CLASS_FIRST ? 1u << (cached.keys[k] - KEY_CLASS_FIRST) : 0;
+        }
+        return mask;
+    };
+    vector<uint32_t> reported;
+    for(size_t a = 0; a < cache.size(); a++)
+    {
+        /* Once per distinct keybind, the first of its chain */
+        const action& bigger = cache[a];
+        if(bigger.ordinal != 0 || bigger.keyCount == 0)
+        {
+            continue;
+        }
+        /* Proper subsets fire on the way, taps and holds never do. All of the keys can still overlap through the classes */
+        bool onTheWay = bigger.keyCount >= 2 && bigger.trigger != TRIGGER_TAP && bigger.trigger != TRIGGER_HOLD;
+        unsigned full = (1u << bigger.keyCount) - 1;
+        reported.clear();
+        for(unsigned mask = onTheWay ? 1 : full; mask <= full; mask++)
+        {
+            /* Every way to write the keys: a modifier as its class, a class as its left or right key */
+            uint16_t options[MAX_CHORD_KEYS][3];
+            int optionCount[MAX_CHORD_KEYS];
+            int choice[MAX_CHORD_KEYS] = {};
+            int n = 0;
+            for(int b = 0; b < bigger.keyCount; b++)
+            {
+                if(!(mask >> b & 1))
+                {
+                    continue;
+                }
+                int key = bigger.keys[b];
+                int c = key >= KEY_CLASS_FIRST ? key - KEY_CLASS_FIRST : keyClass(key);
+                options[n][0] = key;
+                optionCount[n] = c < 0 ? 1 : key >= KEY_CLASS_FIRST ? 3 : 2;
+                options[n][1] = key >= KEY_CLASS_FIRST ? classKeys[c][0] : KEY_CLASS_FIRST + c;
+                options[n][2] = key >= KEY_CLASS_FIRST ? classKeys[c][1] : 0;
+                n++;
+            }
+            for(bool more = true; more;)
+            {
+                uint16_t keys[MAX_CHORD_KEYS];
+                bool written = true;
+                for(int k = 0; k < n; k++)
+                {
+                    keys[k] = options[k][choice[k]];
+                    written &= choice[k] == 0;
+                }
+                sort(keys, keys + n);
+                int count = unique(keys, keys + n) - keys;
+                uint64_t signature = bigger.layer + triggerSignature(bigger.trigger);
+                for(int k = 0; k < count; k++)
+                {
+                    signature += keySignature(keys[k]);
+                }
+                /* Next choice, the first option of every key is the keybind as written */
+                int k = 0;
+                while(k < n && ++choice[k] == optionCount[k])
+                {
+                    choice[k++] = 0;
+                }
+                more = k < n;
+
+                slot* found = mask == full && written ? nullptr : findSlot(parsed, signature);
+                for(uint32_t s = found ? found->first : NO_ACTION; s < REMOVED_ACTIONS; s = cache[s].next)
+                {
+                    /* Signatures can collide, compare the actual keys */
+                    const action& smaller = cache[s];
+                    if(smaller.ordinal != 0 || smaller.layer != bigger.layer || smaller.trigger != bigger.trigger || smaller.keyCount != count
+                        || !equal(keys, keys + count, smaller.keys) || find(reported.begin(), reported.end(), s) != reported.end())
+                    {
+                        continue;
+                    }
+                    if(mask != full)
+                    {
+                        cout << where[a] << ": warning: " << chordName(parsed, smaller) << " (" << where[s]
+                             << ") also fires while " << chordName(parsed, bigger) << " is pressed or released key by key\n";
+                    }
+                    else if(classMaskOf(bigger) < classMaskOf(smaller))
+                    {
+                        /* The same keys held match both, match() tries the keys with fewer classes first */
+                        cout << where[s] << ": warning: " << chordName(parsed, smaller) << " never fires for the keys of "
+                             << chordName(parsed, bigger) << " (" << where[a] << "), that one is matched first\n";
+                    }
+                    else
+                    {
+                        continue;
+                    }
+                    reported.push_back(s);
+                    warnings++;
+                }
+            }
+        }
+    }
+}
+
+int Keybinds::check()
+{
+    /* Always parse, the binary cache would hide skipped keybinds */
+    sourceSet set;
+    set.check = true;
+    if(!loadSources(file, set, 0) || !loadDropIns(set))
+    {
+        for(table* part : set.parts)
+        {
+            delete part;
+        }
+        return 1;
+    }
+    vector<pair<uint32_t, uint32_t>> origins;
+    vector<string> paths = set.paths;
+    table& parsed = *merge(set, &origins);
+    unique_ptr<table> owned(&parsed);
+
+    /* file:line of every keybind, overridden keybinds are already gone */
+    vector<string> where;
+    where.reserve(origins.size());
+    for(const auto& origin : origins)
+    {
+        where.push_back(paths[origin.first] + ":" + to_string(set.lines[origin.first][origin.second]));
+    }
+
+    unsigned errors = set.skipped;
+    unsigned warnings = 0;
+    const vector<action>& cache = parsed.cache;
+    for(size_t a = 0; a < cache.size(); a++)
+    {
+        const action& cached = cache[a];
+        uint32_t first = a;
+        if(cached.ordinal != 0)
+        {
+            /* The chain is in file order, its first action like this one is the earliest keybind with these keys, taps and hold time */
+            first = findSlot(parsed, cached.signature)->first;
+            while(memcmp(cache[first].keys, cached.keys, sizeof(cached.keys)) != 0 || cache[first].taps != cached.taps || cache[first].hold != cached.hold)
+            {
+                first = cache[first].next;
+            }
+        }
+        /* Ordered keybinds with the same keys in a different order don't overlap */
+        bool reordered = cached.ordered && cache[first].ordered && memcmp(cached.order, cache[first].order, sizeof(cached.order)) != 0;
+        if(cached.ordinal != 0 && first != a && !reordered)
+        {
+            bool same = cache[first].content == cached.content;
+            cout << where[a] << ": error: " << chordName(parsed, cached) << " is already bound at " << where[first]
+                 << (same ? " to the same command" : ", both commands fire") << "\n";
+            errors++;
+        }
+        if(cached.target != 0 && layerName(parsed, cached.target) == "?")
+        {
+            cout << where[a] << ": error: " << chordName(parsed, cached) << " switches to a layer that is not defined\n";
+            errors++;
+        }
+        for(int k = 0; k < cached.keyCount; k++)
+        {
+            if(cached.keys[k] == KEY_RESERVED || !keyCodeName(cached.keys[k]))
+            {
+                cout << where[a] << ": warning: key " << cached.keys[k] << " of " << chordName(parsed, cached)
+                     << " is never sent by a device\n";
+                warnings++;
+            }
+        }
+    }
+    checkSubsets(parsed, where, warnings);
+
+    cout << file << ": " << paths.size() << " files, " << cache.size() << " keybinds, " << errors << " errors, " << warnings << " warnings" << endl;
+    return errors ? 1 : warnings ? 2 : 0;
+}
+
+
+/*
+    --------------------
+    | Input Sources    |
+    --------------------
+*/
+
+/*
+    - An input source produces raw input_events for the Listener
+        - DeviceSource reads a live /dev/input/eventX through libevdev
+        - ReplaySource reads a file written by the Recorder
+    - Recording file format (host byte order):
+        - Header: magic "KBREC", version, device input_id, name length, name
+        - Followed by one recordedEvent per input_event, every type including EV_SYN
+*/
+
+#define RECORDING_MAGIC "KBREC"
+#define RECORDING_VERSION 1
+
+struct recordedEvent
+{
+    uint32_t sec;
+    uint32_t usec;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+class InputSource
+{
+    public:
+        virtual ~InputSource() {}
+        virtual bool open() = 0;
+        /* 0 = event read, 1 = end of stream, -1 = error */
+        virtual int next(struct input_event& ev) = 0;
+        /* Blocks until an event can be read (0), timerFd is readable (1) or exitFd is (2), -1 = error */
+        virtual int wait(int /*timerFd*/, int /*exitFd*/) { return 0; }
+        /* Exclusive access, other applications only get the events written to output. Devices only */
+        virtual bool grab(OutputDevice& /*output*/) { return false; }
+
+        /* Device metadata, stored in recordings */
+        string name;
+        struct input_id id = {};
+
+        /* Event timestamps are CLOCK_MONOTONIC, on the same clock as monotonicUs() */
+        bool monotonic = false;
+};
+
+class DeviceSource : public InputSource
+{
+    public:
+        DeviceSource(const char* _device) : device(_device) {}
+        ~DeviceSource();
+        bool open() override;
+        int next(struct input_event& ev) override;
+        int wait(int timerFd, int exitFd) override;
+        bool grab(OutputDevice& output) override;
+    private:
+        const char* device;
+        struct libevdev *dev = nullptr;
+        int fd = -1;
+        /* Events of the resync after a SYN_DROPPED, handed out before reading on */
+        vector<struct input_event> synced;
+        size_t syncedNext = 0;
+};
+
+bool DeviceSource::open()
+{
+    fd = ::open(device, O_RDONLY); // Open device, blocking (wait for events)
+    if(libevdev_new_from_fd(fd, &dev) < 0)
+    {
+        return false;
+    }
+    name = libevdev_get_name(dev);
+    id.bustype = libevdev_get_id_bustype(dev);
+    id.vendor = libevdev_get_id_vendor(dev);
+    id.product = libevdev_get_id_product(dev);
+    id.version = libevdev_get_id_version(dev);
+    /* EVIOCSCLOCKID, the default CLOCK_REALTIME jumps with NTP and suspend */
+    monotonic = libevdev_set_clock_id(dev, CLOCK_MONOTONIC) == 0;
+    return true;
+}
+
+int DeviceSource::next(struct input_event& ev)
+{
+    if(syncedNext < synced.size())
+    {
+        ev = synced[syncedNext++];
+        return 0;
+    }
+    int status = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
+    if(status == LIBEVDEV_READ_STATUS_SYNC)
+    {
+        /* The kernel buffer overflowed (SYN_DROPPED): libevdev hands out the difference to the state of the device,
+           keys released in the meantime included. The SYN_DROPPED ends the partial frame before it as a SYN_REPORT */
+        synced.clear();
+        syncedNext = 0;
+        struct input_event change;
+        while(libevdev_next_event(dev, LIBEVDEV_READ_FLAG_SYNC, &change) == LIBEVDEV_READ_STATUS_SYNC)
+        {
+            synced.push_back(change);
+        }
+        ev.code = SYN_REPORT;
+        return 0;
+    }
+    return status == LIBEVDEV_READ_STATUS_SUCCESS ? 0 : -1;
+}
+
+int DeviceSource::wait(int timerFd, int exitFd)
+{
+    /* libevdev can hold events it already read from the device */
+    if(syncedNext < synced.size() || libevdev_has_event_pending(dev) > 0)
+    {
+        return 0;
+    }
+    /* A negative exitFd is ignored by poll() */
+    struct pollfd fds[3] = { { fd, POLLIN, 0 }, { timerFd, POLLIN, 0 }, { exitFd, POLLIN, 0 } };
+    while(poll(fds, 3, -1) < 0)
+    {
+        if(errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    /* Events first, a timer due while they were queued fires when they are handled */
+    return fds[0].revents ? 0 : fds[1].revents ? 1 : 2;
+}
+
+bool DeviceSource::grab(OutputDevice& output)
+{
+    /* EVIOCGRAB, released when the device is closed */
+    return output.open(dev) && libevdev_grab(dev, LIBEVDEV_GRAB) == 0;
+}
+
+DeviceSource::~DeviceSource()
+{
+    if(dev)
+    {
+        libevdev_free(dev);
+    }
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+class ReplaySource : public InputSource
+{
+    public:
+        ReplaySource(const char* _path, bool _fast) : path(_path), fast(_fast) {}
+        bool open() override;
+        int next(struct input_event& ev) override;
+    private:
+        const char* path;
+        /* Replay as fast as possible instead of at the original speed */
+        bool fast;
+        ifstream file;
+
+        /* Original speed: offset between the recording timeline and CLOCK_MONOTONIC, in microseconds */
+        long long offset = 0;
+        bool started = false;
+};
 
-    for(int i = 0; i < cache.size(); i++)
+bool ReplaySource::open()
+{
+    file.open(path, ios::binary);
+    char magic[sizeof(RECORDING_MAGIC)];
+    uint32_t version;
+    uint16_t nameLength;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&version, sizeof(version));
+    file.read((char*)&id, sizeof(id));
+    file.read((char*)&nameLength, sizeof(nameLength));
+    if(!file || memcmp(magic, RECORDING_MAGIC, sizeof(magic)) != 0 || version != RECORDING_VERSION)
     {
-        cout << "Action: " << cache[i].command << endl;
-        cout << "Keybind: " << endl;
-        for(const auto& element : cache[i].keybind)
-        {
-            cout << "KEY: " << element.keyInt << " - ";
-        }
-        cout << endl << "--------------------" << endl;
+        return false;
     }
-};
-
+    name.resize(nameLength);
+    file.read(&name[0], nameLength);
+    return bool(file);
+}
 
-void Keybinds::checkKeybind(struct input_event ev)
+int ReplaySource::next(struct input_event& ev)
 {
-    updateKeysHeld(ev.code, ev.value);
+    recordedEvent record;
+    if(!file.read((char*)&record, sizeof(record)))
+    {
+        return file.eof() ? 1 : -1;
+    }
+    ev.time.tv_sec = record.sec;
+    ev.time.tv_usec = record.usec;
+    ev.type = record.type;
+    ev.code = record.code;
+    ev.value = record.value;
 
-    int matches;
-    for (int i = 0; i < cache.size(); i++)
+    if(!fast)
     {
-        /* If the amount of keys held is not equal to the amount of keybind keys, continue to the next keybind */
-        if (cache[i].keybind.size() != keysHeld.size())
+        long long eventUs = record.sec * 1000000LL + record.usec;
+        if(!started)
         {
-            continue;
+            offset = monotonicUs() - eventUs;
+            started = true;
         }
-        matches = 0;
-        for (auto it = cache[i].keybind.begin(); it != cache[i].keybind.end(); it++)
+        long long wait = eventUs + offset - monotonicUs();
+        if(wait > 0)
         {
-            /* 
-                Iterate through the keybinds of each action 
-                Check if the held keys match the keybind of the action in any order
-                - Make sure the keybind is not longer than the keys held
-                If they do, execute the command
-                If they don't, break out of the loop and continue to the next action
-            */
-            for (auto it2 = keysHeld.begin(); it2 != keysHeld.end(); it2++)
-            {
-                if (it->keyInt == it2->keyInt)
-                {
-                    matches++;
-                    logger.showKeysHeld && logger.log("Matched key: " + to_string(it->keyInt) + " with key: " + to_string(it2->keyInt));
-                }
-            }
-            if (matches == cache[i].keybind.size())
-            {
-                system(cache[i].command.c_str());
-                logger.log("Executed command: " + cache[i].command);
-                break;
-            }
+            usleep(wait);
         }
-    };
-};
+    }
+    return 0;
+}
 
 
-void Keybinds::reloadCache()
-{
-    cache.clear();
+/*
+    --------------------
+    | Recorder Class   |
+    --------------------
+*/
 
-    ifstream inputFile(file);
-    if(inputFile.is_open())
-    {
-        json data;
-        inputFile >> data;
+class Recorder
+{
+    public:
+        bool open(const char* path, const InputSource& source);
+        void record(const struct input_event& ev);
+    private:
+        ofstream file;
+};
 
-        for(const auto& actionJson : data)
-        {
-            action newAction;
-            newAction.command = actionJson["command"];
+bool Recorder::open(const char* path, const InputSource& source)
+{
+    file.open(path, ios::binary | ios::trunc);
+    uint32_t version = RECORDING_VERSION;
+    uint16_t nameLength = source.name.size();
+    file.write(RECORDING_MAGIC, sizeof(RECORDING_MAGIC));
+    file.write((const char*)&version, sizeof(version));
+    file.write((const char*)&source.id, sizeof(source.id));
+    file.write((const char*)&nameLength, sizeof(nameLength));
+    file.write(source.name.data(), nameLength);
+    return bool(file);
+}
 
-            for(const auto& keybindJson : actionJson["keybind"])
-            {
-                key newKeybind;
-                newKeybind.keyInt = keybindJson["key"];
-                newKeybind.modifier = keybindJson["modifier"];
-                
-                newAction.keybind.insert(newKeybind);
-            };
-            
-            cache.push_back(newAction);
-        }
+void Recorder::record(const struct input_event& ev)
+{
+    recordedEvent record;
+    record.sec = ev.time.tv_sec;
+    record.usec = ev.time.tv_usec;
+    record.type = ev.type;
+    record.code = ev.code;
+    record.value = ev.value;
+    file.write((const char*)&record, sizeof(record));
 
-        inputFile.close();
-        logger.log("Cache has been reloaded");
-        printCache();
-    }
-    else
+    /* Flush once per frame so an interrupted recording is still usable */
+    if(ev.type == EV_SYN && ev.code == SYN_REPORT)
     {
-        logger.error("Unable to open file: " + string(file));
+        file.flush();
     }
 }
 
@@ -355,33 +5298,148 @@ class Listener
 
         /* eventX to listen */
         const char* device;
-        
+
+        /* Replay a recording instead of listening to a device */
+        const char* replayFile = nullptr;
+        bool replayFast = false;
+
+        /* Record every event received to this file */
+        const char* recordFile = nullptr;
+
+        /* Print matched commands instead of executing them */
+        bool dryRun = false;
+
+        /* Replay with the actions stubbed and fail if any event after the first one allocates */
+        bool checkAllocations = false;
+
+        /* Main config file */
+        const char* configFile = "keybinds.json";
+        /* xkb keymap of the keyboard, the US layout when not given */
+        const char* keymapFile = nullptr;
+
+        /* Grab the device and pass its events on through a virtual clone, replays print what would be passed on */
+        bool grab = false;
+
         Logger logger;
 
         void init();
         void listen();
         void stop();
     private:
-        /* Libevdev */
-        struct libevdev *dev;
-        int fd;
-        int err;
+        InputSource* source = nullptr;
+        Recorder recorder;
+        bool recording = false;
         struct input_event ev;
+        OutputDevice output;
+        OutputDevice emitter;
+
+        SystemClock systemClock;
+        /* Advanced to the timestamp of every event */
+        VirtualClock virtualClock;
+        bool eventClock = false;
+
+        /* Wakes the listener when the next timer of the keybinds is due, live devices only */
+        int timerFd = -1;
+        /* Wakes the listener when a command exits, to reap it, live devices only */
+        int exitFd = -1;
+        long long armedAt = -1;
+        void armTimer();
+        void runTimers(long long until);
         
         Keybinds keybinds;
 };
 
 void Listener::init()
 {
-    logger.log("Using device: " + string(device));
-    fd = open(device, O_RDONLY); // Open device, blocking (wait for events)
-    err = libevdev_new_from_fd(fd, &dev);
-    if (err < 0) {
-        logger.error("Failed to init libevdev on device: " + string(device));
-        stop();
+    keybinds.dryRun = dryRun;
+    keybinds.stubActions = checkAllocations;
+    keybinds.file = configFile;
+    string error;
+    if(keymapFile && !keybinds.layout.load(keymapFile, error))
+    {
+        logger.error(error);
         exit(1);
     }
-    debug && logger.log("Initialized libevdev on device: " + string(device));
+    keybinds.reloadCache();
+
+    if(replayFile)
+    {
+        logger.log("Replaying recording: " + string(replayFile));
+        source = new ReplaySource(replayFile, replayFast);
+        if(!source->open())
+        {
+            logger.error("Failed to open recording: " + string(replayFile));
+            stop();
+            exit(1);
+        }
+        debug && logger.log("Recorded device: " + source->name);
+    }
+    else
+    {
+        logger.log("Using device: " + string(device));
+        source = new DeviceSource(device);
+        if(!source->open())
+        {
+            logger.error("Failed to init libevdev on device: " + string(device));
+            stop();
+            exit(1);
+        }
+        debug && logger.log("Initialized libevdev on device: " + string(device));
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timerFd < 0)
+        {
+            logger.error("Failed to create the timer of tap and hold keybinds");
+            stop();
+            exit(1);
+        }
+        if(!source->monotonic)
+        {
+            logger.log("Device timestamps are not monotonic, timing uses the time events are read");
+        }
+        /* Before the watcher thread, it inherits the blocked SIGCHLD */
+        exitFd = keybinds.executor.watchExits();
+        keybinds.startWatcher();
+    }
+
+    /* Kernel timestamps when they can be trusted: recordings, and devices switched to CLOCK_MONOTONIC */
+    eventClock = replayFile || source->monotonic;
+    keybinds.clock = eventClock ? (Clock*)&virtualClock : (Clock*)&systemClock;
+    keybinds.debug = debug;
+
+    if(grab)
+    {
+        output.clock = keybinds.clock;
+        output.print = replayFile;
+        if(!replayFile && !source->grab(output))
+        {
+            logger.error("Failed to grab the device and create its virtual clone (is uinput loaded?)");
+            stop();
+            exit(1);
+        }
+        keybinds.output = &output;
+        debug && logger.log("Grabbed the device, events are passed on through a virtual clone");
+    }
+
+    /* Created up front, a reload can add "emit" keybinds at any time */
+    emitter.clock = keybinds.clock;
+    emitter.print = replayFile || dryRun;
+    if(!emitter.print && !checkAllocations && !emitter.create("keybindsmanager virtual keyboard"))
+    {
+        logger.log("Failed to create the virtual keyboard (is uinput loaded?), \"emit\" keybinds send nothing");
+    }
+    keybinds.emitter = &emitter;
+
+    if(recordFile)
+    {
+        if(!recorder.open(recordFile, *source))
+        {
+            logger.error("Unable to open recording file: " + string(recordFile));
+            stop();
+            exit(1);
+        }
+        recording = true;
+        logger.log("Recording events to: " + string(recordFile));
+    }
 }
 
 void Listener::listen()
@@ -389,33 +5447,356 @@ void Listener::listen()
     debug && logger.log("Listening for events");
     while(true)
     {
-        err = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_NORMAL, &ev);
-        
-        if (err == LIBEVDEV_READ_STATUS_SUCCESS) {
-            
+        /* The source blocks until the next event is available, no need to sleep in between */
+        int status = 0;
+        if(timerFd >= 0)
+        {
+            /* Devices also wake up for the timers of the keybinds, only while one is pending */
+            armTimer();
+            status = source->wait(timerFd, exitFd);
+            if(status == 1)
+            {
+                uint64_t expirations;
+                while(read(timerFd, &expirations, sizeof(expirations)) > 0) {}
+                runTimers(monotonicUs());
+                continue;
+            }
+            if(status == 2)
+            {
+                keybinds.executor.reap();
+                continue;
+            }
+        }
+        status = status < 0 ? status : source->next(ev);
+
+        if (status == 0) {
+
+            if(recording)
+            {
+                recorder.record(ev);
+            }
+            long long eventUs = ev.time.tv_sec * 1000000LL + ev.time.tv_usec;
+            /* Timers due before the event, recordings resolve them here as well (at any replay speed) */
+            runTimers(eventClock ? eventUs : monotonicUs());
+            if(eventClock)
+            {
+                virtualClock.advance(eventUs);
+            }
+
             if(ev.type == EV_KEY)
             {
-                debug && logger.log("Event: type " + to_string(ev.type) + ", code " + to_string(ev.code) + ", value " + to_string(ev.value));
+                debug && logger.log("Event: type " + to_string(ev.type) + ", code " + to_string(ev.code) + ", value " + to_string(ev.value)
+                    + (eventClock && !replayFile ? ", " + to_string(monotonicUs() - eventUs) + " us after the kernel timestamp" : ""));
                 keybinds.checkKeybind(ev);
             }
+            else if(grab)
+            {
+                output.push(ev);
+                debug && ev.type == EV_SYN && eventClock && !replayFile
+                    && logger.log("Frame passed on " + to_string(monotonicUs() - eventUs) + " us after the kernel timestamp");
+            }
+            /* Anything lazily set up by the first event is not steady state */
+            countAllocations = checkAllocations;
         
+        } else if (status == 1) {
+            /* Whatever is still waiting resolves as if the recording went on without input */
+            runTimers(LLONG_MAX);
+            countAllocations = false;
+            logger.log("Replay finished");
+            if(checkAllocations)
+            {
+                logger.log("Allocations after the first event: " + to_string(allocationCount));
+                stop();
+                exit(allocationCount == 0 ? 0 : 1);
+            }
+            return;
         } else {
             // Error occurred or the device was disconnected
             logger.error("Failed to get next event. Was the device disconnected?");
             stop();
             exit(1);
         }
+    }
+}
+
+void Listener::runTimers(long long until)
+{
+    /* Every timer fires at its own time, the event clock is advanced to it first */
+    for(long long due; (due = keybinds.nextTimer()) >= 0 && due <= until;)
+    {
+        if(eventClock)
+        {
+            virtualClock.advance(due);
+        }
+        keybinds.runTimers();
+    }
+}
 
-        /* Prevent 100% CPU usage */
-        usleep(1000);
+void Listener::armTimer()
+{
+    /* Event timestamps and the system clock are both CLOCK_MONOTONIC, only rearmed when the next timer changes */
+    long long due = keybinds.nextTimer();
+    if(due == armedAt)
+    {
+        return;
+    }
+    armedAt = due;
+    struct itimerspec spec = {};
+    if(due >= 0)
+    {
+        due = max(due, 1LL); // 0 disarms
+        spec.it_value.tv_sec = due / 1000000;
+        spec.it_value.tv_nsec = due % 1000000 * 1000;
     }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
 }
 
 void Listener::stop()
 {
-    libevdev_free(dev);
-    close(fd);
-    debug && logger.log("Stopped libevdev");
+    delete source;
+    source = nullptr;
+    if(timerFd >= 0)
+    {
+        close(timerFd);
+        timerFd = -1;
+    }
+    keybinds.executor.closeExits();
+    exitFd = -1;
+    debug && logger.log("Stopped listening");
+}
+
+
+/*
+    --------------------
+    | Stress Bench     |
+    --------------------
+*/
+
+/*
+    - Pushes synthetic key streams through the real keybinds.json with the actions stubbed out
+    - Runs on the virtual clock, the generator advances it 1-30 ms per event
+    - Scenarios:
+        - typing: random keys with rollover (next key pressed before the previous is released)
+        - chords: the configured keybinds pressed and released in random order, sometimes with an extra key
+        - autorepeat: a key or keybind held down with long runs of value 2 events
+        - Every scenario releases what it pressed, the next one starts with nothing held
+        - grabbed chords: the chords scenario passed on to an output device (--grab) that discards the frames,
+          each event followed by its SYN_REPORT, it measures the routing and the copy into the frame, not the write to uinput
+*/
+
+class StressBench
+{
+    public:
+        /* Events per scenario */
+        long events = 1000000;
+        const char* configFile = "keybinds.json";
+
+        int run();
+    private:
+        Keybinds keybinds;
+        VirtualClock clock;
+        /* Neither opened nor printing: frames are built and dropped */
+        OutputDevice output;
+        long long virtualTime = 0;
+        uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+        vector<vector<int>> chords;
+        vector<struct input_event> stream;
+        vector<uint32_t> latencies; // Nanoseconds per event
+
+        uint64_t random();
+        void push(int code, int value);
+        void generateTyping();
+        void generateChords();
+        void generateAutorepeat();
+        /* Returns the number of keybinds that fired */
+        unsigned long runScenario(const char* name);
+};
+
+uint64_t StressBench::random()
+{
+    /* xorshift64, deterministic so runs are comparable */
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+void StressBench::push(int code, int value)
+{
+    virtualTime += 1000 + random() % 29000;
+    struct input_event ev = {};
+    ev.time.tv_sec = virtualTime / 1000000;
+    ev.time.tv_usec = virtualTime % 1000000;
+    ev.type = EV_KEY;
+    ev.code = code;
+    ev.value = value;
+    stream.push_back(ev);
+}
+
+void StressBench::generateTyping()
+{
+    int previous = -1;
+    while((long)stream.size() < events)
+    {
+        /* Letters, digits and punctuation of the main block */
+        int code = KEY_1 + random() % (KEY_SLASH - KEY_1 + 1);
+        push(code, 1);
+        if(previous >= 0)
+        {
+            push(previous, 0);
+        }
+        previous = code;
+    }
+    /* The next scenario starts with nothing held */
+    if(previous >= 0)
+    {
+        push(previous, 0);
+    }
+}
+
+void StressBench::generateChords()
+{
+    while((long)stream.size() < events)
+    {
+        vector<int> keys = chords[random() % chords.size()];
+        if(random() % 4 == 0)
+        {
+            keys.push_back(KEY_A + random() % 10);
+        }
+        for(size_t i = keys.size(); i > 1; i--)
+        {
+            swap(keys[i - 1], keys[random() % i]);
+        }
+        for(int code : keys)
+        {
+            push(code, 1);
+        }
+        for(size_t i = keys.size(); i > 1; i--)
+        {
+            swap(keys[i - 1], keys[random() % i]);
+        }
+        for(int code : keys)
+        {
+            push(code, 0);
+        }
+    }
+}
+
+void StressBench::generateAutorepeat()
+{
+    while((long)stream.size() < events)
+    {
+        vector<int> keys;
+        if(random() % 2 == 0)
+        {
+            keys = chords[random() % chords.size()];
+        }
+        else
+        {
+            keys.push_back(KEY_1 + random() % (KEY_SLASH - KEY_1 + 1));
+        }
+        for(int code : keys)
+        {
+            push(code, 1);
+        }
+        int repeats = 20 + random() % 80;
+        for(int i = 0; i < repeats; i++)
+        {
+            push(keys.back(), 2);
+        }
+        for(int code : keys)
+        {
+            push(code, 0);
+        }
+    }
+}
+
+unsigned long StressBench::runScenario(const char* name)
+{
+    latencies.clear();
+    latencies.reserve(stream.size());
+    unsigned long matchesBefore = keybinds.matchCount;
+
+    long long start = monotonicUs();
+    struct timespec before, after;
+    struct input_event syn = {};
+    syn.type = EV_SYN;
+    syn.code = SYN_REPORT;
+    for(const auto& ev : stream)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        clock.advance(ev.time.tv_sec * 1000000LL + ev.time.tv_usec);
+        keybinds.runTimers();
+        keybinds.checkKeybind(ev);
+        if(keybinds.output)
+        {
+            keybinds.output->push(syn);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        latencies.push_back((after.tv_sec - before.tv_sec) * 1000000000L + after.tv_nsec - before.tv_nsec);
+    }
+    double seconds = (monotonicUs() - start) / 1000000.0;
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [this](double p) {
+        return latencies[(size_t)(p / 100.0 * (latencies.size() - 1))];
+    };
+
+    cout << "Scenario: " << name << endl;
+    cout << "    events: " << stream.size() << ", matches: " << keybinds.matchCount - matchesBefore << endl;
+    cout << "    throughput: " << stream.size() / seconds / 1000000.0 << " M events/s (" << seconds << " s)" << endl;
+    cout << "    latency (ns): p50 " << percentile(50) << ", p90 " << percentile(90) << ", p99 " << percentile(99)
+         << ", p99.9 " << percentile(99.9) << ", max " << latencies.back() << endl;
+    if(keybinds.output)
+    {
+        cout << "    frames copied and discarded, the write to uinput is not measured" << endl;
+    }
+    return keybinds.matchCount - matchesBefore;
+}
+
+int StressBench::run()
+{
+    keybinds.file = configFile;
+    keybinds.reloadCache();
+    chords = keybinds.chords();
+    if(chords.empty())
+    {
+        cerr << "No keybinds loaded, nothing to benchmark" << endl;
+        return 1;
+    }
+    keybinds.clock = &clock;
+    keybinds.stubActions = true;
+
+    cout << "--------------------" << endl;
+    cout << "Stress bench: " << chords.size() << " keybinds, " << events << " events per scenario" << endl;
+    cout << "--------------------" << endl;
+
+    stream.clear();
+    stream.reserve(events + 256);
+    generateTyping();
+    runScenario("typing");
+
+    /* The chords are the keybinds, a run where none of them fires measured nothing */
+    stream.clear();
+    generateChords();
+    bool matched = runScenario("chords") > 0;
+
+    stream.clear();
+    generateAutorepeat();
+    runScenario("autorepeat");
+
+    stream.clear();
+    generateChords();
+    output.clock = &clock;
+    keybinds.output = &output;
+    matched &= runScenario("grabbed chords") > 0;
+    if(!matched)
+    {
+        cerr << "The chords scenarios matched no keybind" << endl;
+        return 1;
+    }
+    return 0;
 }
 
 
@@ -427,7 +5808,50 @@ void Listener::stop()
 
 int main(int argc, char* argv[])
 {
+    const char* configFile = "keybinds.json";
+    const char* keymapFile = nullptr;
+    for(int i = 0; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            configFile = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--keymap") == 0 && i + 1 < argc)
+        {
+            keymapFile = argv[i + 1];
+        }
+    }
+
+    /* The stress bench and the config check run on their own, without a device or the Listener */
+    for(int i = 0; i < argc; i++)
+    {
+        if(strcmp(argv[i], "--check") == 0)
+        {
+            Keybinds keybinds;
+            keybinds.file = configFile;
+            string error;
+            if(keymapFile && !keybinds.layout.load(keymapFile, error))
+            {
+                Logger().error(error);
+                return 1;
+            }
+            return keybinds.check();
+        }
+        if(strcmp(argv[i], "--bench") == 0)
+        {
+            StressBench bench;
+            bench.configFile = configFile;
+            if(i + 1 < argc && atol(argv[i + 1]) > 0)
+            {
+                bench.events = atol(argv[i + 1]);
+            }
+            return bench.run();
+        }
+    }
+
     Listener listener;
+    listener.configFile = configFile;
+    listener.keymapFile = keymapFile;
     string path;
     for(int i = 0; i < argc; i++)
     {
@@ -446,11 +5870,48 @@ int main(int argc, char* argv[])
         {
             listener.debug = true;
         }
+        if(strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            listener.recordFile = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            listener.replayFile = argv[i + 1];
+        }
+        if(strcmp(argv[i], "--fast") == 0)
+        {
+            listener.replayFast = true;
+        }
+        if(strcmp(argv[i], "--dry-run") == 0)
+        {
+            listener.dryRun = true;
+        }
+        if(strcmp(argv[i], "--check-alloc") == 0)
+        {
+            listener.checkAllocations = true;
+        }
+        if(strcmp(argv[i], "--grab") == 0)
+        {
+            listener.grab = true;
+        }
+    }
+
+    if(listener.checkAllocations && !listener.replayFile)
+    {
+        listener.logger.error("--check-alloc needs a recording, use '--replay file'");
+        exit(1);
+    }
+#ifndef CHECK_ALLOCATIONS
+    if(listener.checkAllocations)
+    {
+        listener.logger.error("--check-alloc needs a build with -DCHECK_ALLOCATIONS");
+        exit(1);
     }
+#endif
 
-    if(path.empty())
+    if(path.empty() && !listener.replayFile)
     {
-        listener.logger.error("No device specified. Please specify a device with '-d eventX'");
+        listener.logger.error("No device specified. Please specify a device with '-d eventX' or a recording with '--replay file'");
         exit(1);
     }
 